@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A block device. */
 struct block
@@ -17,10 +20,62 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    /* Request queue, protected by disabling interrupts. */
+    const struct scheduler *sched;      /* Orders QUEUE. */
+    struct list queue;                  /* Requests not yet dispatched. */
+    struct list fifo;                   /* Same requests, by deadline. */
+    unsigned queue_depth;               /* Max requests at driver,
+                                           0 to bypass the queue. */
+    unsigned in_flight;                 /* Requests now at driver. */
+    block_sector_t head;                /* Sector after last dispatched. */
+
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long command_cnt;     /* Requests dispatched to driver,
+                                           after merging. */
+
+    /* More statistics, for struct block_stats. */
+    block_sector_t next_sector;         /* Sector after last request
+                                           submitted. */
+    unsigned long long sequential_cnt;  /* Requests at NEXT_SECTOR. */
+    unsigned long long random_cnt;      /* Other requests. */
+    unsigned long long complete_cnt;    /* Requests completed. */
+    uint64_t busy_tsc;                  /* Total TSC cycles that
+                                           IN_FLIGHT was nonzero. */
+    uint64_t busy_start;                /* TSC when IN_FLIGHT last
+                                           became nonzero. */
+    unsigned long long latency_ticks[BLOCK_TICK_BUCKETS];
+    unsigned long long latency_tsc[BLOCK_TSC_BUCKETS];
+  };
+
+/* An I/O scheduler, which picks the order in which a device's
+   queued requests go to its driver. */
+struct scheduler
+  {
+    const char *name;
+    /* Adds R to BLOCK's queue. */
+    void (*add) (struct block *, struct block_request *r);
+    /* Returns the request in BLOCK's nonempty queue to dispatch
+       next, without removing it. */
+    struct block_request *(*next) (struct block *);
   };
 
+static const struct scheduler noop_scheduler;
+static const struct scheduler clook_scheduler;
+static const struct scheduler deadline_scheduler;
+
+/* Scheduler given to newly registered block devices. */
+static const struct scheduler *default_scheduler = &deadline_scheduler;
+
+/* Ticks that a read or a write may wait in the deadline
+   scheduler's queue before it jumps ahead of elevator order. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (TIMER_FREQ * 5)
+
+/* Maximum number of sectors that merging may combine into a
+   single command. */
+#define MERGE_MAX 256
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +83,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static bool try_merge (struct block *, struct block_request *);
+static void dispatch (struct block *);
+static void record_latency (struct block_request *);
+static list_less_func deadline_less;
+static list_less_func sector_less;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +173,22 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Transfers sector SECTOR between BLOCK and BUFFER, in the
+   direction given by WRITE, and waits for it to finish. */
+static void
+transfer_sync (struct block *block, bool write, block_sector_t sector,
+               void *buffer)
+{
+  struct block_request r;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  block_request_init (&r, block, write, sector, 1, buffer);
+  r.done = &done;
+  block_submit (&r);
+  sema_down (&done);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +196,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync (block, false, sector, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +207,284 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync (block, true, sector, (void *) buffer);
+}
+
+/* Initializes R to transfer SECTOR_CNT sectors starting at
+   SECTOR between BLOCK and BUFFER, which must have room for
+   SECTOR_CNT * BLOCK_SECTOR_SIZE bytes, in the direction given
+   by WRITE.  The caller may then set R's COMPLETE, DONE, and
+   AUX members before submitting it. */
+void
+block_request_init (struct block_request *r, struct block *block, bool write,
+                    block_sector_t sector, block_sector_t sector_cnt,
+                    void *buffer)
+{
+  r->block = block;
+  r->write = write;
+  r->sector = sector;
+  r->sector_cnt = sector_cnt;
+  r->buffer = buffer;
+  r->complete = NULL;
+  r->done = NULL;
+  r->aux = NULL;
+  r->origin = NULL;
+}
+
+/* Starts request R, which must have been initialized with
+   block_request_init().  Returns without waiting for R to
+   complete, unless R's device only supports synchronous
+   transfers, in which case R is complete on return. */
+void
+block_submit (struct block_request *r)
+{
+  struct block *block = r->block;
+
+  ASSERT (r->sector_cnt > 0);
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->sector_cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  if (r->write)
+    block->write_cnt += r->sector_cnt;
+  else
+    block->read_cnt += r->sector_cnt;
+  if (r->sector == block->next_sector)
+    block->sequential_cnt++;
+  else
+    block->random_cnt++;
+  block->next_sector = r->sector + r->sector_cnt;
+
+  /* Time R from its first submission, not from when a stacked
+     device passes it on. */
+  if (r->origin == NULL)
+    {
+      r->origin = block;
+      r->start_ticks = timer_ticks ();
+      r->start_tsc = timer_tsc ();
+    }
+
+  r->next = NULL;
+  if (block->ops->submit == NULL)
+    {
+      /* Synchronous driver: do the whole transfer right now. */
+      uint64_t start = timer_tsc ();
+      block_sector_t i;
+
+      for (i = 0; i < r->sector_cnt; i++)
+        {
+          uint8_t *buffer = (uint8_t *) r->buffer + i * BLOCK_SECTOR_SIZE;
+          if (r->write)
+            block->ops->write (block->aux, r->sector + i, buffer);
+          else
+            block->ops->read (block->aux, r->sector + i, buffer);
+        }
+      block->command_cnt += r->sector_cnt;
+      block->busy_tsc += timer_tsc () - start;
+      block_complete (r);
+    }
+  else if (block->queue_depth == 0)
+    {
+      /* Stacked device: pass R straight through. */
+      block->command_cnt++;
+      block->ops->submit (block->aux, r);
+    }
+  else
+    {
+      enum intr_level old_level = intr_disable ();
+      r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE
+                                      : READ_DEADLINE);
+      if (!try_merge (block, r))
+        {
+          block->sched->add (block, r);
+          list_insert_ordered (&block->fifo, &r->fifo_elem,
+                               deadline_less, NULL);
+        }
+      dispatch (block);
+      intr_set_level (old_level);
+    }
+}
+
+/* Returns the total number of sectors in R and the requests
+   merged into it. */
+static block_sector_t
+request_sectors (const struct block_request *r)
+{
+  block_sector_t cnt = 0;
+
+  for (; r != NULL; r = r->next)
+    cnt += r->sector_cnt;
+  return cnt;
+}
+
+/* Tries to merge R into a request in BLOCK's queue for adjacent
+   sectors in the same direction.  Returns true if successful,
+   false if R must be queued by itself. */
+static bool
+try_merge (struct block *block, struct block_request *r)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request, elem);
+      block_sector_t q_cnt = request_sectors (q);
+
+      if (q->write != r->write || q_cnt + r->sector_cnt > MERGE_MAX)
+        continue;
+
+      if (q->sector + q_cnt == r->sector)
+        {
+          /* Back merge: append R to Q's chain. */
+          struct block_request *tail = q;
+          while (tail->next != NULL)
+            tail = tail->next;
+          tail->next = r;
+          return true;
+        }
+      else if (r->sector + r->sector_cnt == q->sector)
+        {
+          /* Front merge: R takes Q's place, with Q's chain behind
+             it and the earlier of the two deadlines. */
+          r->next = q;
+          if (q->deadline < r->deadline)
+            r->deadline = q->deadline;
+          list_insert (&q->elem, &r->elem);
+          list_remove (&q->elem);
+          list_insert (&q->fifo_elem, &r->fifo_elem);
+          list_remove (&q->fifo_elem);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Hands requests from BLOCK's queue to its driver, in the order
+   chosen by BLOCK's scheduler, until the queue is empty or the
+   driver has as many as it can take. */
+static void
+dispatch (struct block *block)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (block->in_flight < block->queue_depth
+         && !list_empty (&block->queue))
+    {
+      struct block_request *r = block->sched->next (block);
+      list_remove (&r->elem);
+      list_remove (&r->fifo_elem);
+      if (block->in_flight++ == 0)
+        block->busy_start = timer_tsc ();
+      block->command_cnt++;
+      block->head = r->sector + request_sectors (r);
+      block->ops->submit (block->aux, r);
+    }
+}
+
+/* Returns true if request A_ is due before request B_. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct block_request *a
+    = list_entry (a_, struct block_request, fifo_elem);
+  const struct block_request *b
+    = list_entry (b_, struct block_request, fifo_elem);
+  return a->deadline < b->deadline;
+}
+
+/* Returns true if request A_ starts at a lower sector than
+   request B_. */
+static bool
+sector_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* noop scheduler: dispatches requests in arrival order, merging
+   them but never reordering. */
+static void
+noop_add (struct block *block, struct block_request *r)
+{
+  list_push_back (&block->queue, &r->elem);
+}
+
+static struct block_request *
+noop_next (struct block *block)
+{
+  return list_entry (list_front (&block->queue), struct block_request, elem);
+}
+
+static const struct scheduler noop_scheduler = {"noop", noop_add, noop_next};
+
+/* C-LOOK elevator: keeps the queue sorted by sector and sweeps
+   upward from the last sector dispatched, jumping back to the
+   lowest sector when nothing lies ahead. */
+static void
+clook_add (struct block *block, struct block_request *r)
+{
+  list_insert_ordered (&block->queue, &r->elem, sector_less, NULL);
+}
+
+static struct block_request *
+clook_next (struct block *block)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector >= block->head)
+        return r;
+    }
+  return list_entry (list_front (&block->queue), struct block_request, elem);
+}
+
+static const struct scheduler clook_scheduler =
+  {"clook", clook_add, clook_next};
+
+/* Deadline scheduler: C-LOOK, except that a request that has
+   waited past its deadline is dispatched first.  Reads get a
+   much shorter deadline than writes, since a thread is usually
+   waiting on them. */
+static struct block_request *
+deadline_next (struct block *block)
+{
+  struct block_request *oldest
+    = list_entry (list_front (&block->fifo), struct block_request, fifo_elem);
+  return timer_ticks () >= oldest->deadline ? oldest : clook_next (block);
+}
+
+static const struct scheduler deadline_scheduler =
+  {"deadline", clook_add, deadline_next};
+
+/* Makes the I/O scheduler called NAME, which must be "noop",
+   "clook", or "deadline", the one used by all block devices.
+   Returns true if successful, false if NAME is unknown. */
+bool
+block_set_scheduler (const char *name)
+{
+  static const struct scheduler *schedulers[] =
+    {&noop_scheduler, &clook_scheduler, &deadline_scheduler};
+  struct list_elem *e;
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (!strcmp (name, schedulers[i]->name))
+      break;
+  if (i >= sizeof schedulers / sizeof *schedulers)
+    return false;
+
+  default_scheduler = schedulers[i];
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    list_entry (e, struct block, list_elem)->sched = default_scheduler;
+  return true;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +508,100 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Returns the number of sectors read from BLOCK so far. */
+unsigned long long
+block_read_cnt (struct block *block)
+{
+  return block->read_cnt;
+}
+
+/* Returns the number of sectors written to BLOCK so far. */
+unsigned long long
+block_write_cnt (struct block *block)
+{
+  return block->write_cnt;
+}
+
+/* Stores BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  enum intr_level old_level = intr_disable ();
+
+  stats->read_bytes = block->read_cnt * BLOCK_SECTOR_SIZE;
+  stats->write_bytes = block->write_cnt * BLOCK_SECTOR_SIZE;
+  stats->sequential_cnt = block->sequential_cnt;
+  stats->random_cnt = block->random_cnt;
+  stats->complete_cnt = block->complete_cnt;
+  stats->busy_tsc = block->busy_tsc;
+  if (block->in_flight > 0)
+    stats->busy_tsc += timer_tsc () - block->busy_start;
+  memcpy (stats->latency_ticks, block->latency_ticks,
+          sizeof stats->latency_ticks);
+  memcpy (stats->latency_tsc, block->latency_tsc, sizeof stats->latency_tsc);
+
+  intr_set_level (old_level);
+}
+
+/* Adds VALUE to the CNT-bucket latency histogram H.  See struct
+   block_stats for the bucket sizes. */
+static void
+histogram_add (unsigned long long *h, size_t cnt, uint64_t value)
+{
+  size_t bucket;
+
+  for (bucket = 0; value > 0 && bucket < cnt - 1; bucket++)
+    value >>= 1;
+  h[bucket]++;
+}
+
+/* Records the latency of request R, which just completed, for
+   the device it was submitted to and, if it differs, the device
+   that carried it out. */
+static void
+record_latency (struct block_request *r)
+{
+  int64_t ticks = timer_ticks () - r->start_ticks;
+  uint64_t tsc = timer_tsc () - r->start_tsc;
+  struct block *block = r->origin;
+
+  for (;;)
+    {
+      block->complete_cnt++;
+      histogram_add (block->latency_ticks, BLOCK_TICK_BUCKETS, ticks);
+      histogram_add (block->latency_tsc, BLOCK_TSC_BUCKETS, tsc);
+      if (block == r->block)
+        break;
+      block = r->block;
+    }
+}
+
+/* Prints the nonempty buckets of BLOCK's CNT-bucket latency
+   histogram H, measured in UNITs.  A bucket labeled 2^I covers
+   latencies from 2**I up to 2**(I+1). */
+static void
+print_histogram (struct block *block, const char *unit,
+                 const unsigned long long *h, size_t cnt)
+{
+  size_t i;
+
+  printf ("%s: latency in %s:", block->name, unit);
+  for (i = 0; i < cnt; i++)
+    if (h[i] > 0)
+      {
+        if (i == 0)
+          printf (" 0:%llu", h[i]);
+        else
+          printf (" %s2^%zu:%llu", i == cnt - 1 ? ">=" : "", i - 1, h[i]);
+      }
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +614,39 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  /* Commands reaching each queued device, which merging keeps
+     below the number of sectors. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->queue_depth > 0 && block->command_cnt > 0)
+        printf ("%s: %llu commands (%s scheduler)\n",
+                block->name, block->command_cnt, block->sched->name);
+    }
+
+  /* Access pattern and latency of each device that did any I/O. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      unsigned long long submit_cnt = (block->sequential_cnt
+                                       + block->random_cnt);
+      if (block->complete_cnt == 0)
+        continue;
+
+      printf ("%s: %llu bytes read, %llu bytes written, "
+              "%llu%% sequential, busy %llu cycles\n",
+              block->name, block->read_cnt * BLOCK_SECTOR_SIZE,
+              block->write_cnt * BLOCK_SECTOR_SIZE,
+              block->sequential_cnt * 100 / submit_cnt,
+              (unsigned long long) block->busy_tsc);
+      print_histogram (block, "ticks", block->latency_ticks,
+                       BLOCK_TICK_BUCKETS);
+      print_histogram (block, "cycles", block->latency_tsc,
+                       BLOCK_TSC_BUCKETS);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -198,8 +669,22 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
+  block->sched = default_scheduler;
+  list_init (&block->queue);
+  list_init (&block->fifo);
+  block->queue_depth = ops->submit != NULL ? 1 : 0;
+  block->in_flight = 0;
+  block->head = 0;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->command_cnt = 0;
+  block->next_sector = 0;
+  block->sequential_cnt = 0;
+  block->random_cnt = 0;
+  block->complete_cnt = 0;
+  block->busy_tsc = 0;
+  memset (block->latency_ticks, 0, sizeof block->latency_ticks);
+  memset (block->latency_tsc, 0, sizeof block->latency_tsc);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +696,53 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Sets the number of requests that BLOCK's driver can work on
+   at once to DEPTH.  The block layer queues any more, which is
+   what gives it the chance to reorder and merge them.  The
+   default is 1 for drivers with a SUBMIT operation.  A DEPTH of
+   0 passes requests straight to the driver, which suits stacked
+   devices that only forward requests to a device with a queue
+   of its own. */
+void
+block_set_queue_depth (struct block *block, unsigned depth)
+{
+  ASSERT (block->ops->submit != NULL);
+  ASSERT (list_empty (&block->queue) && block->in_flight == 0);
+  block->queue_depth = depth;
+}
+
+/* Called by a block device driver, possibly from an interrupt
+   handler, when it has finished transferring request R and the
+   requests merged into it.  Notifies their submitters and
+   dispatches more of the device's queued requests. */
+void
+block_complete (struct block_request *r)
+{
+  struct block *block = r->block;
+
+  while (r != NULL)
+    {
+      /* A request may be freed as soon as DONE is up'd, so its
+         successor has to be fetched first. */
+      struct block_request *next = r->next;
+      record_latency (r);
+      if (r->complete != NULL)
+        r->complete (r);
+      if (r->done != NULL)
+        sema_up (r->done);
+      r = next;
+    }
+
+  if (block->queue_depth > 0)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (--block->in_flight == 0)
+        block->busy_tsc += timer_tsc () - block->busy_start;
+      dispatch (block);
+      intr_set_level (old_level);
+    }
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -1,8 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -56,19 +58,118 @@ void block_write (struct block *, block_sector_t, const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous block device operations.
+
+   A block_request describes a transfer of one or more
+   consecutive sectors.  block_submit() queues it with the
+   device's driver and returns at once; when the transfer is
+   done, the driver calls block_complete(), which invokes the
+   request's COMPLETE callback and ups its DONE semaphore,
+   whichever are non-null.  Completion may happen in an
+   interrupt handler, so COMPLETE must not sleep.
+
+   The request and its buffer belong to the block layer until
+   completion.  While routing the request to the underlying
+   device, e.g. from a partition to its disk, the block layer
+   may change BLOCK and SECTOR.
+
+   Requests wait in a per-device queue, whose scheduler may
+   reorder them and merge requests for adjacent sectors into a
+   single command.  Requests that are outstanding at the same
+   time may therefore complete in any order: a submitter that
+   cares must wait for one request before submitting the next. */
+struct semaphore;
+struct block_request
+  {
+    struct block *block;                /* Device. */
+    bool write;                         /* True to write, false to read. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t sector_cnt;          /* Number of sectors. */
+    void *buffer;                       /* SECTOR_CNT sectors of data. */
+    void (*complete) (struct block_request *); /* Callback, or null. */
+    struct semaphore *done;             /* Up'd at completion, or null. */
+    void *aux;                          /* For the submitter's use. */
+
+    /* Owned by block layer and driver. */
+    struct list_elem elem;              /* Element in a request queue. */
+    struct block_request *next;         /* Next request merged into
+                                           this one, or null. */
+    struct list_elem fifo_elem;         /* Element in deadline FIFO. */
+    int64_t deadline;                   /* Timer tick to dispatch by. */
+    struct block *origin;               /* Device first submitted to. */
+    int64_t start_ticks;                /* Timer tick when submitted. */
+    uint64_t start_tsc;                 /* TSC when submitted. */
+  };
+
+void block_request_init (struct block_request *, struct block *, bool write,
+                         block_sector_t sector, block_sector_t sector_cnt,
+                         void *buffer);
+void block_submit (struct block_request *);
+
+/* I/O scheduling. */
+bool block_set_scheduler (const char *name);
+
 /* Statistics. */
+
+/* Buckets in the latency histograms of struct block_stats. */
+#define BLOCK_TICK_BUCKETS 16
+#define BLOCK_TSC_BUCKETS 40
+
+/* Activity of a block device since boot.
+
+   Latency is the time from block_submit() to block_complete(),
+   queueing included.  Histogram bucket 0 counts requests with a
+   latency of 0, bucket I > 0 those with a latency of at least
+   2**(I-1) and less than 2**I, and the last bucket also counts
+   anything longer.
+
+   A request is sequential if it starts at the sector after the
+   previous request submitted to the device ended, and random
+   otherwise. */
+struct block_stats
+  {
+    unsigned long long read_bytes;      /* Bytes read. */
+    unsigned long long write_bytes;     /* Bytes written. */
+    unsigned long long sequential_cnt;  /* Sequential requests. */
+    unsigned long long random_cnt;      /* Random requests. */
+    unsigned long long complete_cnt;    /* Requests completed. */
+    unsigned long long busy_tsc;        /* TSC cycles that the driver
+                                           had requests to work on. */
+    unsigned long long latency_ticks[BLOCK_TICK_BUCKETS];
+    unsigned long long latency_tsc[BLOCK_TSC_BUCKETS];
+  };
+
 void block_print_stats (void);
+unsigned long long block_read_cnt (struct block *);
+unsigned long long block_write_cnt (struct block *);
+void block_get_stats (struct block *, struct block_stats *);
 
-/* Lower-level interface to block device drivers. */
+/* Lower-level interface to block device drivers.
+
+   A driver provides either READ and WRITE, which transfer one
+   sector and return when it is done, or SUBMIT, which starts
+   a block_request and arranges for block_complete() to be
+   called on it later.  If SUBMIT is non-null, READ and WRITE
+   are not used.
+
+   SUBMIT is passed a request that may have others merged into
+   it through its NEXT member.  Together they cover consecutive
+   sectors in the same direction and must be transferred as a
+   unit, after which the driver calls block_complete() once,
+   on the first request.  SUBMIT is called with interrupts
+   off. */
 
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*submit) (void *aux, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_queue_depth (struct block *, unsigned depth);
+void block_complete (struct block_request *);
 
 #endif /* devices/block.h */
@@ -1,17 +1,27 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the
+   controller is a PCI bus master IDE controller, such as the
+   PIIX that QEMU emulates, disks that support it transfer data
+   by DMA instead of PIO. */
+
+/* If false, never use DMA, even if it is available. */
+bool ide_use_dma = true;
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -24,6 +34,32 @@
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
+/* Bus master IDE port addresses, relative to the I/O base that
+   the controller's PCI BAR 4 assigns to each channel. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master status register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
+/* A physical region descriptor: one entry in the table that
+   tells the bus master where in memory a DMA transfer goes.  A
+   region must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Bytes in region, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))  /* Entries per table. */
+
 /* ATA control block port addresses.
    (If we supported non-legacy ATA controllers this would not be
    flexible enough, but it's fine for what we do.) */
@@ -34,6 +70,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +86,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors that one read or write command can transfer.
+   (A sector count register value of 0 means 256.) */
+#define MAX_COMMAND_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,20 +103,53 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt in READ/WRITE
+                                   MULTIPLE, or 0 if not supported. */
+    bool dma;                   /* Transfer by DMA? */
+    struct list queue;          /* Pending block_requests. */
   };
 
 /* An ATA channel (aka controller).
-   Each channel can control up to two disks. */
+   Each channel can control up to two disks.
+
+   A channel carries out one block_request at a time, together
+   with any requests the block layer merged into it, taking
+   turns between its disks' queues.  A request is transferred
+   with as few commands as possible, each of up to
+   MAX_COMMAND_SECTORS sectors.  The disk interrupts once per
+   sector, or once per block of sectors if it supports READ/WRITE
+   MULTIPLE, and each interrupt moves the data and then starts the
+   next command or request, so once a request is started the
+   whole transfer runs from the interrupt handler.  With DMA, the
+   bus master moves the data of a whole command and the disk
+   interrupts just once, at the end.  The queues and CUR are
+   protected by disabling interrupts.
+
+   The two channels share no state and have interrupts of their
+   own, so requests for disks on different channels overlap from
+   start to finish, whereas disks on one channel take turns.  For
+   this reason the file system and swap partitions are best put
+   on different channels, e.g. the file system on hda and swap on
+   hdc, which is what "pintos --swap-size" does. */
 struct channel
   {
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base port, 0 if no DMA. */
+    struct prd *prdt;           /* PRD table, if BM_BASE is nonzero. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore completion_wait;   /* Up'd by interrupt handler
+                                           when no request is active. */
+
+    struct block_request *cur;  /* Request in progress, or null. */
+    struct ata_disk *cur_disk;  /* Disk that CUR is for. */
+    struct block_request *cur_part; /* CUR or a request merged into it. */
+    block_sector_t cur_done;    /* Sectors of CUR_PART transferred. */
+    block_sector_t cmd_left;    /* Sectors of the current command that
+                                   have not yet crossed the data port. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -85,13 +164,24 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max_multiple);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
+static void start_request (struct channel *);
+static void start_command (struct channel *);
+static void start_dma (struct channel *);
+static void transfer_block (struct channel *);
+static void finish_block (struct channel *, uint8_t status);
+static void finish_dma (struct channel *, uint8_t status);
+static void finish_command (struct channel *);
+
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool wait_for_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,8 +191,21 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  struct pci_dev *pci;
+  uint16_t bm_base = 0;
   size_t chan_no;
 
+  /* Look for a PCI IDE controller in compatibility mode, that
+     is, at the legacy ports that we use, that can do bus master
+     DMA. */
+  pci = pci_find_class (0x01, 0x01, NULL);
+  if (pci != NULL && ide_use_dma && (pci->prog_if & 0x85) == 0x80)
+    {
+      bm_base = pci_io_bar (pci, 4);
+      if (bm_base != 0)
+        pci_enable (pci, PCI_CMD_IO | PCI_CMD_MASTER);
+    }
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -123,9 +226,18 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->cur = NULL;
+      c->cur_disk = NULL;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +248,9 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          list_init (&d->queue);
         }
 
       /* Register interrupt handler. */
@@ -262,6 +377,7 @@ identify_ata_device (struct ata_disk *d)
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
+  int max_multiple;
   char *model, *serial;
   char extra_info[128];
   struct block *block;
@@ -284,6 +400,8 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  max_multiple = (uint8_t) id[47 * 2];
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -303,12 +421,37 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  set_multiple_mode (d, max_multiple);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D, which IDENTIFY DEVICE
+   said can transfer up to MAX_MULTIPLE sectors per interrupt, 0
+   meaning it does not support those commands.  Sets D's
+   MULTIPLE member to the number of sectors per interrupt in
+   effect, or 0 if D did not accept the command. */
+static void
+set_multiple_mode (struct ata_disk *d, int max_multiple)
+{
+  struct channel *c = d->channel;
+
+  d->multiple = 0;
+  if (max_multiple == 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max_multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_alt_status (c)) & STA_ERR))
+    d->multiple = max_multiple;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,63 +480,284 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues block request R for disk D, starting it at once if
+   D's channel is idle.  The interrupt handler carries out the
+   rest of the transfer and completes R. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
-}
+  enum intr_level old_level;
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
-{
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  old_level = intr_disable ();
+  list_push_back (&d->queue, &r->elem);
+  if (c->cur == NULL)
+    start_request (c);
+  intr_set_level (old_level);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    ide_submit
   };
-
+
+/* Starts the next queued request on idle channel C, if there is
+   one.  The disk that did not go last gets the first chance, so
+   that one busy disk cannot starve the other. */
+static void
+start_request (struct channel *c)
+{
+  int first = c->cur_disk != NULL ? !c->cur_disk->dev_no : 0;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->cur == NULL);
+
+  for (i = 0; i < 2; i++)
+    {
+      struct ata_disk *d = &c->devices[(first + i) % 2];
+      if (!list_empty (&d->queue))
+        {
+          struct list_elem *e = list_pop_front (&d->queue);
+          c->cur = list_entry (e, struct block_request, elem);
+          c->cur_disk = d;
+          c->cur_part = c->cur;
+          c->cur_done = 0;
+          start_command (c);
+          return;
+        }
+    }
+}
+
+/* Returns the part of channel C's current request's buffers
+   that holds the next sector to transfer. */
+static void *
+cur_buffer (struct channel *c)
+{
+  return (uint8_t *) c->cur_part->buffer + c->cur_done * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the current sector of channel C's current request. */
+static block_sector_t
+cur_sector (struct channel *c)
+{
+  return c->cur_part->sector + c->cur_done;
+}
+
+/* Issues a command for as many of the remaining sectors of
+   channel C's current request as one command can transfer.  For
+   a write, also sends the first block of data, since the disk
+   only interrupts once it has the data. */
+static void
+start_command (struct channel *c)
+{
+  struct ata_disk *d = c->cur_disk;
+  struct block_request *part;
+  block_sector_t cnt;
+
+  /* Merged requests cover consecutive sectors, so one command
+     can span several of them. */
+  cnt = c->cur_part->sector_cnt - c->cur_done;
+  for (part = c->cur_part->next; part != NULL; part = part->next)
+    cnt += part->sector_cnt;
+  if (cnt > MAX_COMMAND_SECTORS)
+    cnt = MAX_COMMAND_SECTORS;
+  c->cmd_left = cnt;
+
+  if (d->dma)
+    {
+      start_dma (c);
+      return;
+    }
+
+  select_sector (d, cur_sector (c), cnt);
+  if (!c->cur->write)
+    issue_pio_command (c, d->multiple ? CMD_READ_MULTIPLE
+                       : CMD_READ_SECTOR_RETRY);
+  else
+    {
+      issue_pio_command (c, d->multiple ? CMD_WRITE_MULTIPLE
+                         : CMD_WRITE_SECTOR_RETRY);
+      if (!wait_for_drq (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, cur_sector (c));
+      transfer_block (c);
+    }
+}
+
+/* Advances channel C's position in its current request by one
+   sector. */
+static void
+advance_sector (struct channel *c)
+{
+  if (++c->cur_done == c->cur_part->sector_cnt)
+    {
+      c->cur_part = c->cur_part->next;
+      c->cur_done = 0;
+    }
+}
+
+/* Starts a DMA command for the next CMD_LEFT sectors of channel
+   C's current request.  The sectors may be spread across several
+   merged requests' buffers, so the PRD table gets at least one
+   region per buffer, split further at 64 kB boundaries. */
+static void
+start_dma (struct channel *c)
+{
+  struct ata_disk *d = c->cur_disk;
+  struct block_request *part = c->cur_part;
+  block_sector_t part_ofs = c->cur_done;
+  block_sector_t left = c->cmd_left;
+  size_t prd_cnt = 0;
+
+  while (left > 0)
+    {
+      block_sector_t cnt = part->sector_cnt - part_ofs;
+      uint8_t *p = (uint8_t *) part->buffer + part_ofs * BLOCK_SECTOR_SIZE;
+      size_t size;
+
+      if (cnt > left)
+        cnt = left;
+      ASSERT (is_kernel_vaddr (p));
+      for (size = cnt * BLOCK_SECTOR_SIZE; size > 0; )
+        {
+          uintptr_t addr = vtop (p);
+          size_t region = 0x10000 - (addr & 0xffff);
+          if (region > size)
+            region = size;
+
+          ASSERT (prd_cnt < PRD_CNT);
+          c->prdt[prd_cnt].addr = addr;
+          c->prdt[prd_cnt].size = region;
+          c->prdt[prd_cnt].flags = 0;
+          prd_cnt++;
+
+          p += region;
+          size -= region;
+        }
+
+      left -= cnt;
+      part_ofs += cnt;
+      if (part_ofs == part->sector_cnt)
+        {
+          part = part->next;
+          part_ofs = 0;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, then the disk, then start. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), c->cur->write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+  select_sector (d, cur_sector (c), c->cmd_left);
+  issue_pio_command (c, c->cur->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) | BM_CMD_START);
+}
+
+/* Moves one block of data, that is, as many sectors as the disk
+   transfers per interrupt, between channel C's data register and
+   its current request's buffers. */
+static void
+transfer_block (struct channel *c)
+{
+  int cnt = c->cur_disk->multiple ? c->cur_disk->multiple : 1;
+
+  for (; cnt > 0 && c->cmd_left > 0; cnt--, c->cmd_left--)
+    {
+      if (c->cur->write)
+        output_sector (c, cur_buffer (c));
+      else
+        input_sector (c, cur_buffer (c));
+      advance_sector (c);
+    }
+}
+
+/* Called from the interrupt handler when the disk on channel C
+   is done with a block of the current command, with the STATUS
+   it reported: for a read, the block's data is ready; for a
+   write, the disk has taken the block that we sent.  Moves on to
+   the next block, the next command, or the next request. */
+static void
+finish_block (struct channel *c, uint8_t status)
+{
+  struct ata_disk *d = c->cur_disk;
+  struct block_request *r = c->cur;
+
+  if ((status & STA_ERR) || (c->cmd_left > 0 && !wait_for_drq (d)))
+    PANIC ("%s: disk %s failed, request sector=%"PRDSNu,
+           d->name, r->write ? "write" : "read", r->sector);
+
+  if (c->cmd_left > 0)
+    {
+      /* Read the block that is ready, or send the next one. */
+      transfer_block (c);
+      if (r->write || c->cmd_left > 0)
+        {
+          c->expecting_interrupt = true;
+          return;
+        }
+    }
+
+  finish_command (c);
+}
+
+/* Called from the interrupt handler when the disk on channel C
+   has finished a DMA command, with the STATUS it reported. */
+static void
+finish_dma (struct channel *c, uint8_t status)
+{
+  struct ata_disk *d = c->cur_disk;
+  uint8_t bm_status = inb (reg_bm_status (c));
+
+  outb (reg_bm_command (c), 0);
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  if ((status & STA_ERR) || (bm_status & BM_STA_ERR))
+    PANIC ("%s: DMA %s failed, request sector=%"PRDSNu,
+           d->name, c->cur->write ? "write" : "read", c->cur->sector);
+
+  for (; c->cmd_left > 0; c->cmd_left--)
+    advance_sector (c);
+  finish_command (c);
+}
+
+/* Called when channel C's current command is done.  Starts the
+   next command for the current request, or completes the request
+   and starts the next one. */
+static void
+finish_command (struct channel *c)
+{
+  struct block_request *r = c->cur;
+
+  if (c->cur_part != NULL)
+    start_command (c);
+  else
+    {
+      /* Completing R may dispatch another request to us. */
+      c->cur = NULL;
+      block_complete (r);
+      if (c->cur == NULL)
+        start_request (c);
+    }
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection and
+   sector count registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_COMMAND_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -406,10 +770,6 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
-  /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
-
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
 }
@@ -432,8 +792,10 @@ output_sector (struct channel *c, const void *sector)
 
 /* Low-level ATA primitives. */
 
-/* Wait up to 10 seconds for the controller to become idle, that
+/* Wait up to 10 ms for the controller to become idle, that
    is, for the BSY and DRQ bits to clear in the status register.
+   Busy-waits, so that requests can be started from the
+   interrupt handler.
 
    As a side effect, reading the status register clears any
    pending interrupt. */
@@ -446,7 +808,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +841,25 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Waits up to 10 ms for disk D to clear BSY, without sleeping,
+   and then returns the status of the DRQ bit.  For use once a
+   transfer is under way, when the disk should respond quickly. */
+static bool
+wait_for_drq (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 1000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +870,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -513,8 +894,14 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt) 
           {
-            inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            uint8_t status = inb (reg_status (c)); /* Acknowledge interrupt. */
+            c->expecting_interrupt = false;
+            if (c->cur != NULL && c->cur_disk->dma)
+              finish_dma (c, status);           /* Finish DMA command. */
+            else if (c->cur != NULL)
+              finish_block (c, status);         /* Continue request. */
+            else
+              sema_up (&c->completion_wait);    /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
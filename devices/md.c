@@ -0,0 +1,330 @@
+#include "devices/md.h"
+#include <debug.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* The code in this file combines several block devices into one
+   "md" (multiple device) software RAID array:
+
+   - RAID-0 stripes the array across its members in chunks of
+     CHUNK_SECTORS sectors, so that a large transfer, or several
+     small ones, keeps all of the members busy at once.
+
+   - RAID-1 mirrors the array onto every member.  A write goes
+     to all of them.  A read goes to the member with the fewest
+     requests outstanding, preferring among those the one whose
+     last request ended nearest the sector to read.
+
+   A request to the array is carried out by one or more
+   "pieces," each a request to a single member.  Pieces come
+   from a fixed pool, so that requests can be split without
+   allocating memory, even in an interrupt handler.  A request
+   that does not fit waits for pieces to be freed. */
+
+/* Most members in an array. */
+#define MAX_MEMBERS 4
+
+/* RAID-0 stripe chunk size, in sectors. */
+#define CHUNK_SECTORS 16
+
+/* Number of pieces in each array's pool. */
+#define PIECE_CNT 64
+
+/* A member of an array. */
+struct member
+  {
+    struct block *block;        /* Underlying block device. */
+    unsigned in_flight;         /* Pieces outstanding. */
+    block_sector_t head;        /* Sector after last piece. */
+  };
+
+/* A request to one member, for part or all of a request to the
+   array. */
+struct piece
+  {
+    struct block_request req;   /* Request to member. */
+    struct md *md;              /* Array. */
+    struct block_request *orig; /* Array request, null if free. */
+    size_t member;              /* Index of member. */
+  };
+
+/* An array. */
+struct md
+  {
+    int level;                          /* RAID level, 0 or 1. */
+    struct member members[MAX_MEMBERS]; /* Members. */
+    size_t member_cnt;                  /* Number of members. */
+    struct piece pieces[PIECE_CNT];     /* Pool of pieces. */
+
+    /* Requests with pieces left to issue, and progress on the
+       front one.  Protected by disabling interrupts. */
+    struct list waiting;
+    block_sector_t ofs;                 /* Sectors already issued. */
+    size_t mirror;                      /* RAID-1 write: next member. */
+    bool issuing;                       /* In issue_pieces()? */
+  };
+
+static struct block_operations md_operations;
+
+static void issue_pieces (struct md *);
+
+/* Registers a RAID-LEVEL array named NAME, where LEVEL is 0 or
+   1, over the MEMBER_CNT block devices in MEMBERS, and returns
+   it.  Its size is limited by the smallest member. */
+struct block *
+md_create (const char *name, int level,
+           struct block *members[], size_t member_cnt)
+{
+  struct md *md;
+  struct block *block;
+  block_sector_t member_size, size;
+  char extra_info[64];
+  size_t i;
+
+  ASSERT (level == 0 || level == 1);
+  ASSERT (member_cnt >= 2 && member_cnt <= MAX_MEMBERS);
+
+  md = calloc (1, sizeof *md);
+  if (md == NULL)
+    PANIC ("Failed to allocate memory for md descriptor");
+  md->level = level;
+  md->member_cnt = member_cnt;
+  member_size = block_size (members[0]);
+  for (i = 0; i < member_cnt; i++)
+    {
+      if (block_type (members[i]) == BLOCK_FOREIGN)
+        PANIC ("%s: %s belongs to another operating system",
+               name, block_name (members[i]));
+      md->members[i].block = members[i];
+      if (block_size (members[i]) < member_size)
+        member_size = block_size (members[i]);
+    }
+  for (i = 0; i < PIECE_CNT; i++)
+    md->pieces[i].md = md;
+  list_init (&md->waiting);
+
+  if (level == 0)
+    size = member_size / CHUNK_SECTORS * CHUNK_SECTORS * member_cnt;
+  else
+    size = member_size;
+
+  snprintf (extra_info, sizeof extra_info, "RAID-%d of %s", level,
+            block_name (members[0]));
+  for (i = 1; i < member_cnt; i++)
+    snprintf (extra_info + strlen (extra_info),
+              sizeof extra_info - strlen (extra_info), ",%s",
+              block_name (members[i]));
+  block = block_register (name, BLOCK_RAW, extra_info, size,
+                          &md_operations, md);
+
+  /* The members queue and schedule our pieces. */
+  block_set_queue_depth (block, 0);
+  return block;
+}
+
+/* Creates array "md0" as described by SPEC, which has the form
+   LEVEL:BDEV,BDEV[,BDEV...], e.g. "1:hdb,hdc".  Panics if SPEC
+   is malformed or names a nonexistent block device. */
+void
+md_setup (char *spec)
+{
+  struct block *members[MAX_MEMBERS];
+  size_t member_cnt = 0;
+  char *level, *name, *save_ptr;
+
+  level = spec != NULL ? strtok_r (spec, ":", &save_ptr) : NULL;
+  if (level == NULL || (strcmp (level, "0") && strcmp (level, "1")))
+    PANIC ("md: RAID level must be 0 or 1");
+  for (name = strtok_r (NULL, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      if (member_cnt >= MAX_MEMBERS)
+        PANIC ("md: more than %d devices", MAX_MEMBERS);
+      members[member_cnt] = block_get_by_name (name);
+      if (members[member_cnt] == NULL)
+        PANIC ("md: no such block device \"%s\"", name);
+      member_cnt++;
+    }
+  if (member_cnt < 2)
+    PANIC ("md: array needs at least 2 devices");
+
+  md_create ("md0", atoi (level), members, member_cnt);
+}
+
+/* Queues request R for array MD and issues as much of it as
+   there are free pieces for. */
+static void
+md_submit (void *md_, struct block_request *r)
+{
+  struct md *md = md_;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  list_push_back (&md->waiting, &r->elem);
+  issue_pieces (md);
+  intr_set_level (old_level);
+}
+
+static struct block_operations md_operations =
+  {
+    NULL,
+    NULL,
+    md_submit
+  };
+
+/* Returns a free piece in MD's pool, or a null pointer if all
+   are in use. */
+static struct piece *
+find_free_piece (struct md *md)
+{
+  size_t i;
+
+  for (i = 0; i < PIECE_CNT; i++)
+    if (md->pieces[i].orig == NULL)
+      return &md->pieces[i];
+  return NULL;
+}
+
+/* Returns the index of the RAID-1 member of MD that should read
+   SECTOR. */
+static size_t
+pick_mirror (struct md *md, block_sector_t sector)
+{
+  size_t best = 0;
+  block_sector_t best_dist = (block_sector_t) -1;
+  size_t i;
+
+  for (i = 0; i < md->member_cnt; i++)
+    {
+      struct member *m = &md->members[i];
+      block_sector_t dist = (m->head > sector
+                             ? m->head - sector : sector - m->head);
+
+      if (m->in_flight < md->members[best].in_flight
+          || (m->in_flight == md->members[best].in_flight
+              && dist < best_dist))
+        {
+          best = i;
+          best_dist = dist;
+        }
+    }
+  return best;
+}
+
+static void piece_complete (struct block_request *);
+
+/* Issues pieces of MD's waiting requests to its members until
+   no requests wait or no pieces are free. */
+static void
+issue_pieces (struct md *md)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* A member that completes requests synchronously calls back
+     into us from block_submit().  The loop below picks up
+     anything that the callback would have issued. */
+  if (md->issuing)
+    return;
+  md->issuing = true;
+
+  while (!list_empty (&md->waiting))
+    {
+      struct block_request *r
+        = list_entry (list_front (&md->waiting), struct block_request, elem);
+      struct piece *p = find_free_piece (md);
+      struct member *m;
+      block_sector_t sector, cnt;
+      void *buffer;
+
+      if (p == NULL)
+        break;
+
+      buffer = (uint8_t *) r->buffer + md->ofs * BLOCK_SECTOR_SIZE;
+      if (md->level == 0)
+        {
+          block_sector_t logical = r->sector + md->ofs;
+          block_sector_t chunk = logical / CHUNK_SECTORS;
+          block_sector_t chunk_ofs = logical % CHUNK_SECTORS;
+
+          p->member = chunk % md->member_cnt;
+          sector = chunk / md->member_cnt * CHUNK_SECTORS + chunk_ofs;
+          cnt = CHUNK_SECTORS - chunk_ofs;
+          if (cnt > r->sector_cnt - md->ofs)
+            cnt = r->sector_cnt - md->ofs;
+          md->ofs += cnt;
+        }
+      else
+        {
+          sector = r->sector;
+          cnt = r->sector_cnt;
+          if (!r->write)
+            p->member = pick_mirror (md, sector);
+          else
+            p->member = md->mirror++;
+          if (!r->write || md->mirror == md->member_cnt)
+            md->ofs = cnt;
+        }
+
+      /* Bring MD up to date before submitting, because the piece
+         may complete at once. */
+      if (md->ofs == r->sector_cnt)
+        {
+          list_pop_front (&md->waiting);
+          md->ofs = 0;
+          md->mirror = 0;
+        }
+      m = &md->members[p->member];
+      m->in_flight++;
+      m->head = sector + cnt;
+      p->orig = r;
+      block_request_init (&p->req, m->block, r->write, sector, cnt, buffer);
+      p->req.complete = piece_complete;
+      p->req.aux = p;
+      block_submit (&p->req);
+    }
+
+  md->issuing = false;
+}
+
+/* Returns true if any piece of request R to MD is outstanding
+   or not yet issued. */
+static bool
+request_busy (struct md *md, struct block_request *r)
+{
+  size_t i;
+
+  if (!list_empty (&md->waiting)
+      && list_entry (list_front (&md->waiting),
+                     struct block_request, elem) == r)
+    return true;
+  for (i = 0; i < PIECE_CNT; i++)
+    if (md->pieces[i].orig == r)
+      return true;
+  return false;
+}
+
+/* Called by a member's block layer, possibly from an interrupt
+   handler, when piece REQ is done.  Completes the array request
+   if this was its last piece and reuses the piece. */
+static void
+piece_complete (struct block_request *req)
+{
+  struct piece *p = req->aux;
+  struct md *md = p->md;
+  struct block_request *orig = p->orig;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  md->members[p->member].in_flight--;
+  p->orig = NULL;
+  if (!request_busy (md, orig))
+    block_complete (orig);
+  issue_pieces (md);
+  intr_set_level (old_level);
+}
@@ -0,0 +1,12 @@
+#ifndef DEVICES_MD_H
+#define DEVICES_MD_H
+
+#include <stddef.h>
+
+struct block;
+
+struct block *md_create (const char *name, int level,
+                         struct block *members[], size_t member_cnt);
+void md_setup (char *spec);
+
+#endif /* devices/md.h */
@@ -169,6 +169,7 @@ found_partition (struct block *block, uint8_t part_type,
                               : part_type == 0x23 ? BLOCK_SWAP
                               : BLOCK_FOREIGN);
       struct partition *p;
+      struct block *part;
       char extra_info[128];
       char name[16];
 
@@ -181,7 +182,11 @@ found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      part = block_register (name, type, extra_info, size,
+                             &partition_operations, p);
+
+      /* The disk queues and schedules our requests. */
+      block_set_queue_depth (part, 0);
     }
 }
 
@@ -298,27 +303,20 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
-{
-  struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
-}
-
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
+/* Starts request R on partition P by passing it on to the
+   corresponding sectors of P's underlying block device. */
 static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+partition_submit (void *p_, struct block_request *r)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  r->block = p->block;
+  r->sector += p->start;
+  block_submit (r);
 }
 
 static struct block_operations partition_operations =
   {
-    partition_read,
-    partition_write
+    NULL,
+    NULL,
+    partition_submit
   };
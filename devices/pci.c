@@ -0,0 +1,193 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "threads/io.h"
+
+/* The code in this file enumerates the functions on the PCI
+   bus, using configuration mechanism #1, which every PC since
+   the Pentium supports.  Drivers look up their devices here and
+   then talk to them through their base address registers. */
+
+/* Configuration mechanism #1 ports. */
+#define CONFIG_ADDRESS 0xcf8    /* Selects bus, device, function, reg. */
+#define CONFIG_DATA 0xcfc       /* Reads or writes the selected reg. */
+
+/* Buses and devices per bus to scan. */
+#define BUS_CNT 256
+#define SLOT_CNT 32
+#define FUNC_CNT 8
+
+/* Functions found by pci_init(). */
+#define MAX_DEVS 64
+static struct pci_dev devs[MAX_DEVS];
+static size_t dev_cnt;
+
+static uint32_t config_read (int bus, int slot, int func, int reg);
+static void config_select (int bus, int slot, int func, int reg);
+
+/* Scans the PCI bus and records every function found on it. */
+void
+pci_init (void)
+{
+  int bus, slot, func;
+
+  for (bus = 0; bus < BUS_CNT; bus++)
+    for (slot = 0; slot < SLOT_CNT; slot++)
+      for (func = 0; func < FUNC_CNT; func++)
+        {
+          uint32_t id = config_read (bus, slot, func, PCI_REG_ID);
+          uint32_t class;
+          struct pci_dev *d;
+
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* Nothing here.  If function 0 is missing, the
+                 whole device is. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if (dev_cnt >= MAX_DEVS)
+            {
+              printf ("pci: too many devices, ignoring %02x:%02x.%d\n",
+                      bus, slot, func);
+              continue;
+            }
+          class = config_read (bus, slot, func, PCI_REG_CLASS);
+          d = &devs[dev_cnt++];
+          d->bus = bus;
+          d->slot = slot;
+          d->func = func;
+          d->vendor_id = id & 0xffff;
+          d->device_id = id >> 16;
+          d->class = class >> 24;
+          d->subclass = class >> 16;
+          d->prog_if = class >> 8;
+          d->irq = config_read (bus, slot, func, PCI_REG_INTR);
+
+          /* Only multi-function devices have functions past 0. */
+          if (func == 0
+              && !(config_read (bus, slot, 0, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+
+  printf ("pci: %zu functions found\n", dev_cnt);
+}
+
+/* Returns the next PCI function after AFTER, or the first one if
+   AFTER is null, with the given base CLASS and SUBCLASS.
+   Returns a null pointer if there are no more. */
+struct pci_dev *
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *after)
+{
+  struct pci_dev *d;
+
+  for (d = after != NULL ? after + 1 : devs; d < devs + dev_cnt; d++)
+    if (d->class == class && d->subclass == subclass)
+      return d;
+  return NULL;
+}
+
+/* Returns the next PCI function after AFTER, or the first one if
+   AFTER is null, with the given VENDOR_ID and DEVICE_ID.
+   Returns a null pointer if there are no more. */
+struct pci_dev *
+pci_find_device (uint16_t vendor_id, uint16_t device_id,
+                 struct pci_dev *after)
+{
+  struct pci_dev *d;
+
+  for (d = after != NULL ? after + 1 : devs; d < devs + dev_cnt; d++)
+    if (d->vendor_id == vendor_id && d->device_id == device_id)
+      return d;
+  return NULL;
+}
+
+/* Returns the 32-bit configuration register at offset REG of
+   function D.  REG must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_dev *d, int reg)
+{
+  ASSERT (reg % 4 == 0);
+  return config_read (d->bus, d->slot, d->func, reg);
+}
+
+/* Returns the 16-bit configuration register at offset REG of
+   function D.  REG must be a multiple of 2. */
+uint16_t
+pci_read_config16 (const struct pci_dev *d, int reg)
+{
+  ASSERT (reg % 2 == 0);
+  return pci_read_config (d, reg & ~3) >> (reg & 2) * 8;
+}
+
+/* Returns the 8-bit configuration register at offset REG of
+   function D. */
+uint8_t
+pci_read_config8 (const struct pci_dev *d, int reg)
+{
+  return pci_read_config (d, reg & ~3) >> (reg & 3) * 8;
+}
+
+/* Writes VALUE to the 32-bit configuration register at offset
+   REG of function D.  REG must be a multiple of 4. */
+void
+pci_write_config (const struct pci_dev *d, int reg, uint32_t value)
+{
+  ASSERT (reg % 4 == 0);
+  config_select (d->bus, d->slot, d->func, reg);
+  outl (CONFIG_DATA, value);
+}
+
+/* Writes VALUE to the 16-bit configuration register at offset
+   REG of function D.  REG must be a multiple of 2. */
+void
+pci_write_config16 (const struct pci_dev *d, int reg, uint16_t value)
+{
+  ASSERT (reg % 2 == 0);
+  config_select (d->bus, d->slot, d->func, reg);
+  outw (CONFIG_DATA + (reg & 2), value);
+}
+
+/* Returns the I/O port base of function D's base address
+   register number BAR, which must be an I/O space BAR, or 0 if
+   the BAR is unassigned or maps memory instead. */
+uint16_t
+pci_io_bar (const struct pci_dev *d, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (d, PCI_REG_BAR0 + bar * 4);
+  return value & 1 ? value & 0xfffc : 0;
+}
+
+/* Sets COMMAND_BITS, a combination of PCI_CMD_* bits, in
+   function D's command register. */
+void
+pci_enable (const struct pci_dev *d, uint16_t command_bits)
+{
+  uint16_t command = pci_read_config16 (d, PCI_REG_COMMAND);
+  pci_write_config16 (d, PCI_REG_COMMAND, command | command_bits);
+}
+
+/* Points CONFIG_DATA at configuration register REG of the given
+   BUS, SLOT, and FUNC. */
+static void
+config_select (int bus, int slot, int func, int reg)
+{
+  outl (CONFIG_ADDRESS, (0x80000000 | (bus << 16) | (slot << 11)
+                         | (func << 8) | (reg & 0xfc)));
+}
+
+/* Reads the 32-bit configuration register REG of the given BUS,
+   SLOT, and FUNC. */
+static uint32_t
+config_read (int bus, int slot, int func, int reg)
+{
+  config_select (bus, slot, func, reg);
+  return inl (CONFIG_DATA);
+}
@@ -0,0 +1,49 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdint.h>
+
+/* PCI configuration space registers. */
+#define PCI_REG_ID 0x00           /* Vendor ID (low), device ID (high). */
+#define PCI_REG_COMMAND 0x04      /* Command register (16 bits). */
+#define PCI_REG_CLASS 0x08        /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c       /* Header type is bits 16...23. */
+#define PCI_REG_BAR0 0x10         /* First of six base address registers. */
+#define PCI_REG_CAP_PTR 0x34      /* Offset of first capability. */
+#define PCI_REG_INTR 0x3c         /* Interrupt line (low byte). */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001        /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002    /* Respond to memory accesses. */
+#define PCI_CMD_MASTER 0x0004    /* Allow bus mastering (DMA). */
+
+/* A PCI function found by pci_init(). */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t slot;               /* Device number on bus. */
+    uint8_t func;               /* Function number within device. */
+    uint16_t vendor_id;         /* Vendor ID, e.g. 0x8086 for Intel. */
+    uint16_t device_id;         /* Vendor-specific device ID. */
+    uint8_t class;              /* Base class, e.g. 0x01 for storage. */
+    uint8_t subclass;           /* Subclass, e.g. 0x01 for IDE. */
+    uint8_t prog_if;            /* Programming interface. */
+    uint8_t irq;                /* Interrupt line routed by the BIOS. */
+  };
+
+void pci_init (void);
+struct pci_dev *pci_find_class (uint8_t class, uint8_t subclass,
+                                struct pci_dev *after);
+struct pci_dev *pci_find_device (uint16_t vendor_id, uint16_t device_id,
+                                 struct pci_dev *after);
+
+uint32_t pci_read_config (const struct pci_dev *, int reg);
+uint16_t pci_read_config16 (const struct pci_dev *, int reg);
+uint8_t pci_read_config8 (const struct pci_dev *, int reg);
+void pci_write_config (const struct pci_dev *, int reg, uint32_t);
+void pci_write_config16 (const struct pci_dev *, int reg, uint16_t);
+
+uint16_t pci_io_bar (const struct pci_dev *, int bar);
+void pci_enable (const struct pci_dev *, uint16_t command_bits);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,92 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The code in this file implements a block device kept in
+   memory.  Transfers are plain copies, so a RAM disk lets file
+   system overhead be measured apart from the cost of emulating
+   a disk, and makes fast storage for data that need not outlive
+   the current boot.
+
+   The contents are kept a page at a time, so that a large RAM
+   disk does not need a large run of contiguous memory. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    uint8_t **pages;            /* Contents, a page at a time. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a zeroed RAM disk named NAME with room for SIZE_KB kB,
+   rounded up to a whole number of pages, registers it with the
+   block layer, and returns it.  Panics if memory runs out. */
+struct block *
+ramdisk_create (const char *name, size_t size_kb)
+{
+  struct ramdisk *rd;
+  size_t i;
+
+  ASSERT (size_kb > 0);
+
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+  rd->page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  rd->pages = malloc (rd->page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("%s: out of memory", name);
+  for (i = 0; i < rd->page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("%s: out of memory after %zu of %zu kB",
+               name, i * PGSIZE / 1024, size_kb);
+    }
+
+  return block_register (name, BLOCK_RAW, "RAM disk",
+                         rd->page_cnt * SECTORS_PER_PAGE,
+                         &ramdisk_operations, rd);
+}
+
+/* Returns the data for SECTOR in RD. */
+static uint8_t *
+sector_data (struct ramdisk *rd, block_sector_t sector)
+{
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SEC_NO from RAM disk RD_ into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  memcpy (buffer, sector_data (rd_, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER, which must contain BLOCK_SECTOR_SIZE bytes, to
+   sector SEC_NO of RAM disk RD_. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  memcpy (sector_data (rd_, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL
+  };
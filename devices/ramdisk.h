@@ -0,0 +1,10 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stddef.h>
+
+struct block;
+
+struct block *ramdisk_create (const char *name, size_t size_kb);
+
+#endif /* devices/ramdisk.h */
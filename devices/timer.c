@@ -76,6 +76,16 @@ timer_ticks (void)
   return t;
 }
 
+/* Returns the processor's time-stamp counter, which counts CPU
+   clock cycles, for timing intervals shorter than a tick. */
+uint64_t
+timer_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -12,6 +12,7 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+uint64_t timer_tsc (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
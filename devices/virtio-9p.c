@@ -0,0 +1,170 @@
+#include "devices/virtio-9p.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/pci.h"
+#include "devices/virtio.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives a virtio-9p device, such as the
+   one QEMU attaches with "-virtfs local,...", which exports a
+   directory on the host.  The device carries 9P messages: the
+   driver offers a request and a buffer for the reply on the
+   virtqueue, and the host's 9P server fills in the reply.  There
+   is no network involved, and the data moves by memory copy
+   between host and guest.  filesys/hostfs.c speaks the 9P
+   protocol on top of this.
+
+   Only one transaction is outstanding at a time.  The host
+   usually answers in microseconds, so the driver turns off the
+   device's interrupt and polls for the reply instead, yielding
+   the CPU while it waits.  This also keeps the device off the
+   interrupt line that it likely shares with virtio-blk disks. */
+
+/* PCI device ID of a transitional (legacy-capable) virtio-9p
+   device. */
+#define VIRTIO_9P_DEVICE_ID 0x1009
+
+/* virtio-9p configuration registers, relative to the I/O port in
+   BAR 0. */
+#define REG_TAG_LEN 0x14          /* Length of mount tag (16 bits). */
+#define REG_TAG 0x16              /* Mount tag, not null-terminated. */
+
+/* The virtio-9p device, if any. */
+static bool present;
+static uint16_t io_base;        /* I/O port in BAR 0. */
+static uint16_t queue_size;     /* Entries in virtqueue. */
+static struct vring_desc *desc; /* Descriptor table. */
+static struct vring_avail *avail; /* Available ring. */
+static struct vring_used *used; /* Used ring. */
+static uint16_t last_used;      /* Used ring entries already handled. */
+
+/* Serializes transactions. */
+static struct lock transact_lock;
+
+/* Finds and initializes the virtio-9p device, if there is one. */
+void
+virtio_9p_init (void)
+{
+  struct pci_dev *pci;
+  size_t avail_ofs, used_ofs, page_cnt, i;
+  char tag[32];
+  size_t tag_len;
+  uint8_t *queue;
+
+  lock_init (&transact_lock);
+  pci = pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_9P_DEVICE_ID, NULL);
+  if (pci == NULL)
+    return;
+  io_base = pci_io_bar (pci, 0);
+  if (io_base == 0)
+    {
+      printf ("virtio-9p: no I/O port assigned\n");
+      return;
+    }
+  pci_enable (pci, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and tell it we know how to drive it.  We
+     need none of its optional features. */
+  outb (io_base + REG_STATUS, 0);
+  outb (io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (io_base + REG_GUEST_FEATURES, 0);
+
+  /* Allocate queue 0, which must be physically contiguous, with
+     the used ring on a page boundary. */
+  outw (io_base + REG_QUEUE_SELECT, 0);
+  queue_size = inw (io_base + REG_QUEUE_SIZE);
+  if (queue_size < VIRTIO_9P_MAX_BUFS)
+    {
+      printf ("virtio-9p: unusable queue size %"PRIu16"\n", queue_size);
+      outb (io_base + REG_STATUS, STATUS_FAILED);
+      return;
+    }
+  avail_ofs = sizeof *desc * queue_size;
+  used_ofs = ROUND_UP (avail_ofs + sizeof *avail
+                       + sizeof *avail->ring * (queue_size + 1),
+                       PGSIZE);
+  page_cnt = DIV_ROUND_UP (used_ofs + sizeof *used
+                           + sizeof *used->ring * queue_size
+                           + sizeof (uint16_t), PGSIZE);
+  queue = palloc_get_multiple (PAL_ZERO, page_cnt);
+  if (queue == NULL)
+    PANIC ("virtio-9p: couldn't allocate virtqueue");
+  desc = (struct vring_desc *) queue;
+  avail = (struct vring_avail *) (queue + avail_ofs);
+  used = (struct vring_used *) (queue + used_ofs);
+  avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+  last_used = 0;
+  outl (io_base + REG_QUEUE_PFN, vtop (queue) >> PGBITS);
+
+  outb (io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  present = true;
+
+  tag_len = inw (io_base + REG_TAG_LEN);
+  if (tag_len >= sizeof tag)
+    tag_len = sizeof tag - 1;
+  for (i = 0; i < tag_len; i++)
+    tag[i] = inb (io_base + REG_TAG + i);
+  tag[tag_len] = '\0';
+  printf ("virtio-9p: host directory with mount tag `%s'\n", tag);
+}
+
+/* Returns true if there is a virtio-9p device. */
+bool
+virtio_9p_present (void)
+{
+  return present;
+}
+
+/* Sends the 9P request made of the first OUT_CNT buffers in
+   BUFS to the host, waits for the reply, and stores it in the
+   next IN_CNT buffers.  Returns the length of the reply.  The
+   buffers must be in kernel memory, since the device reaches
+   them by physical address. */
+size_t
+virtio_9p_transact (const struct virtio_9p_buf bufs[], size_t out_cnt,
+                    size_t in_cnt)
+{
+  size_t cnt = out_cnt + in_cnt;
+  size_t len;
+  size_t i;
+
+  ASSERT (present);
+  ASSERT (out_cnt > 0 && in_cnt > 0);
+  ASSERT (cnt <= VIRTIO_9P_MAX_BUFS);
+
+  lock_acquire (&transact_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (is_kernel_vaddr (bufs[i].data));
+      desc[i].addr = vtop (bufs[i].data);
+      desc[i].len = bufs[i].size;
+      desc[i].flags = ((i + 1 < cnt ? VRING_DESC_F_NEXT : 0)
+                       | (i >= out_cnt ? VRING_DESC_F_WRITE : 0));
+      desc[i].next = i + 1;
+    }
+
+  /* The device may look at the ring entry as soon as the index
+     moves, so fill in the entry first. */
+  avail->ring[avail->idx % queue_size] = 0;
+  barrier ();
+  avail->idx++;
+  barrier ();
+  outw (io_base + REG_QUEUE_NOTIFY, 0);
+
+  while (*(volatile uint16_t *) &used->idx == last_used)
+    thread_yield ();
+  barrier ();
+  len = used->ring[last_used % queue_size].len;
+  last_used++;
+  lock_release (&transact_lock);
+
+  return len;
+}
@@ -0,0 +1,22 @@
+#ifndef DEVICES_VIRTIO_9P_H
+#define DEVICES_VIRTIO_9P_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A buffer that is part of a 9P message. */
+struct virtio_9p_buf
+  {
+    void *data;                 /* Kernel virtual address. */
+    size_t size;                /* Length in bytes. */
+  };
+
+/* Most buffers in one transaction. */
+#define VIRTIO_9P_MAX_BUFS 4
+
+void virtio_9p_init (void);
+bool virtio_9p_present (void);
+size_t virtio_9p_transact (const struct virtio_9p_buf[], size_t out_cnt,
+                           size_t in_cnt);
+
+#endif /* devices/virtio-9p.h */
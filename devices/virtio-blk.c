@@ -0,0 +1,363 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "devices/virtio.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio-blk disks, such as those
+   that QEMU attaches with "-drive if=virtio", through the legacy
+   virtio PCI interface described in the Virtio PCI Card
+   Specification, version 0.9.5.
+
+   Unlike an IDE disk, which does one command at a time and
+   traps on every register access, a virtio disk takes requests
+   from a ring in memory shared with the device (the
+   "virtqueue"), so many requests can be outstanding at once and
+   submitting one costs a single port write. */
+
+/* PCI device ID of a transitional (legacy-capable) virtio-blk
+   device. */
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* virtio-blk configuration register, relative to the I/O port in
+   BAR 0. */
+#define REG_CAPACITY 0x14         /* Disk size in sectors (64 bits). */
+
+/* Header that starts every virtio-blk request. */
+struct virtio_blk_req_hdr
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_IN or VIRTIO_BLK_T_OUT. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Status byte for success. */
+
+/* Largest virtqueue that we accept. */
+#define MAX_QUEUE_SIZE 256
+
+/* Descriptors per virtio-blk request: header, data, status. */
+#define SLOT_DESCS 3
+
+/* A virtio-blk request.  Slot I always uses descriptors
+   I * SLOT_DESCS through I * SLOT_DESCS + 2, so that no
+   descriptor allocation is needed.  A slot carries the sectors
+   of one block_request, so a merged chain of requests may take
+   several slots. */
+struct slot
+  {
+    struct virtio_blk_req_hdr hdr;      /* Read by device. */
+    uint8_t status;                     /* Written by device. */
+    struct block_request *chain;        /* Chain this is for, null if free. */
+  };
+
+/* A virtio-blk disk. */
+struct vblk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* I/O port in BAR 0. */
+    uint8_t irq;                /* Interrupt vector. */
+
+    uint16_t queue_size;        /* Entries in virtqueue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Used ring entries already handled. */
+
+    struct slot *slots;         /* Request slots. */
+    size_t slot_cnt;            /* Number of slots. */
+
+    /* Chains that still have parts to issue, and the next part of
+       the front one.  Protected by disabling interrupts. */
+    struct list waiting;
+    struct block_request *next_part;
+  };
+
+/* Disks found. */
+#define MAX_DISKS 4
+static struct vblk disks[MAX_DISKS];
+static size_t disk_cnt;
+
+static struct block_operations vblk_operations;
+
+static bool init_disk (struct vblk *, struct pci_dev *);
+static void issue_requests (struct vblk *);
+static void complete_requests (struct vblk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds and initializes virtio-blk disks, registering each with
+   the block layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev *pci = NULL;
+
+  while ((pci = pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID,
+                                 pci)) != NULL)
+    {
+      struct vblk *d;
+      struct block *block;
+
+      if (disk_cnt >= MAX_DISKS)
+        {
+          printf ("virtio-blk: too many disks, ignoring the rest\n");
+          break;
+        }
+      d = &disks[disk_cnt];
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (!init_disk (d, pci))
+        continue;
+      disk_cnt++;
+
+      block = block_register (d->name, BLOCK_RAW, "virtio-blk",
+                              inl (d->io_base + REG_CAPACITY),
+                              &vblk_operations, d);
+      block_set_queue_depth (block, d->slot_cnt);
+      partition_scan (block);
+    }
+}
+
+/* Sets up the virtio device at PCI function PCI as disk D.
+   Returns true if successful, false on failure. */
+static bool
+init_disk (struct vblk *d, struct pci_dev *pci)
+{
+  size_t avail_ofs, used_ofs, page_cnt, i;
+  uint8_t *queue;
+
+  d->io_base = pci_io_bar (pci, 0);
+  d->irq = pci->irq + 0x20;
+  if (d->io_base == 0 || pci->irq == 0 || pci->irq >= 16)
+    {
+      printf ("%s: no I/O port or interrupt assigned\n", d->name);
+      return false;
+    }
+  if (inl (d->io_base + REG_CAPACITY + 4) != 0)
+    {
+      printf ("%s: ignoring disk of 2 TB or more\n", d->name);
+      return false;
+    }
+  pci_enable (pci, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and tell it we know how to drive it.  We
+     need none of its optional features. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (d->io_base + REG_GUEST_FEATURES, 0);
+
+  /* Allocate queue 0, which must be physically contiguous, with
+     the used ring on a page boundary. */
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  if (d->queue_size == 0 || d->queue_size > MAX_QUEUE_SIZE)
+    {
+      printf ("%s: unusable queue size %"PRIu16"\n", d->name, d->queue_size);
+      outb (d->io_base + REG_STATUS, STATUS_FAILED);
+      return false;
+    }
+  avail_ofs = sizeof *d->desc * d->queue_size;
+  used_ofs = ROUND_UP (avail_ofs + sizeof *d->avail
+                       + sizeof *d->avail->ring * (d->queue_size + 1),
+                       PGSIZE);
+  page_cnt = DIV_ROUND_UP (used_ofs + sizeof *d->used
+                           + sizeof *d->used->ring * d->queue_size
+                           + sizeof (uint16_t), PGSIZE);
+  queue = palloc_get_multiple (PAL_ZERO, page_cnt);
+  d->slot_cnt = d->queue_size / SLOT_DESCS;
+  d->slots = calloc (d->slot_cnt, sizeof *d->slots);
+  if (queue == NULL || d->slots == NULL)
+    PANIC ("%s: couldn't allocate virtqueue", d->name);
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + avail_ofs);
+  d->used = (struct vring_used *) (queue + used_ofs);
+  d->last_used = 0;
+  list_init (&d->waiting);
+  d->next_part = NULL;
+
+  /* Each slot's descriptors point to its header and status. */
+  for (i = 0; i < d->slot_cnt; i++)
+    {
+      struct vring_desc *desc = &d->desc[i * SLOT_DESCS];
+      desc[0].addr = vtop (&d->slots[i].hdr);
+      desc[0].len = sizeof d->slots[i].hdr;
+      desc[0].flags = VRING_DESC_F_NEXT;
+      desc[0].next = i * SLOT_DESCS + 1;
+      desc[1].flags = VRING_DESC_F_NEXT;
+      desc[1].next = i * SLOT_DESCS + 2;
+      desc[2].addr = vtop (&d->slots[i].status);
+      desc[2].len = 1;
+      desc[2].flags = VRING_DESC_F_WRITE;
+    }
+  outl (d->io_base + REG_QUEUE_PFN, vtop (queue) >> PGBITS);
+
+  /* Disks may share an interrupt line, so register each line's
+     handler only once. */
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i == disk_cnt)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Queues block request R, and any requests merged into it, for
+   disk D, issuing as much of it to the device as there are free
+   slots for.  The interrupt handler completes R. */
+static void
+vblk_submit (void *d_, struct block_request *r)
+{
+  struct vblk *d = d_;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  list_push_back (&d->waiting, &r->elem);
+  issue_requests (d);
+  intr_set_level (old_level);
+}
+
+static struct block_operations vblk_operations =
+  {
+    NULL,
+    NULL,
+    vblk_submit
+  };
+
+/* Returns a free slot in disk D, or a null pointer if all are
+   in use. */
+static struct slot *
+find_free_slot (struct vblk *d)
+{
+  size_t i;
+
+  for (i = 0; i < d->slot_cnt; i++)
+    if (d->slots[i].chain == NULL)
+      return &d->slots[i];
+  return NULL;
+}
+
+/* Offers the device as many waiting parts of requests as there
+   are free slots, then notifies it once. */
+static void
+issue_requests (struct vblk *d)
+{
+  bool issued = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&d->waiting))
+    {
+      struct block_request *chain
+        = list_entry (list_front (&d->waiting), struct block_request, elem);
+      struct block_request *part
+        = d->next_part != NULL ? d->next_part : chain;
+      struct slot *s = find_free_slot (d);
+      uint16_t head;
+
+      if (s == NULL)
+        break;
+      head = (s - d->slots) * SLOT_DESCS;
+
+      ASSERT (is_kernel_vaddr (part->buffer));
+      s->chain = chain;
+      s->hdr.type = part->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+      s->hdr.reserved = 0;
+      s->hdr.sector = part->sector;
+      s->status = 0xff;
+      d->desc[head + 1].addr = vtop (part->buffer);
+      d->desc[head + 1].len = part->sector_cnt * BLOCK_SECTOR_SIZE;
+      d->desc[head + 1].flags = (VRING_DESC_F_NEXT
+                                 | (part->write ? 0 : VRING_DESC_F_WRITE));
+
+      /* The device may look at the ring entry as soon as the index
+         moves, so fill in the entry first. */
+      d->avail->ring[d->avail->idx % d->queue_size] = head;
+      barrier ();
+      d->avail->idx++;
+      issued = true;
+
+      d->next_part = part->next;
+      if (d->next_part == NULL)
+        list_pop_front (&d->waiting);
+    }
+
+  if (issued)
+    {
+      barrier ();
+      outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+    }
+}
+
+/* Returns true if any part of CHAIN is still waiting to be issued
+   to disk D or is in progress there. */
+static bool
+chain_busy (struct vblk *d, struct block_request *chain)
+{
+  size_t i;
+
+  if (!list_empty (&d->waiting)
+      && list_entry (list_front (&d->waiting),
+                     struct block_request, elem) == chain)
+    return true;
+  for (i = 0; i < d->slot_cnt; i++)
+    if (d->slots[i].chain == chain)
+      return true;
+  return false;
+}
+
+/* Handles the requests that disk D has finished, completing each
+   chain whose last part is done, then reuses the freed slots. */
+static void
+complete_requests (struct vblk *d)
+{
+  while (d->last_used != *(volatile uint16_t *) &d->used->idx)
+    {
+      struct vring_used_elem *e
+        = &d->used->ring[d->last_used % d->queue_size];
+      struct slot *s = &d->slots[e->id / SLOT_DESCS];
+      struct block_request *chain = s->chain;
+
+      d->last_used++;
+      if (s->status != VIRTIO_BLK_S_OK)
+        PANIC ("%s: disk %s failed, sector=%"PRIu64, d->name,
+               s->hdr.type == VIRTIO_BLK_T_OUT ? "write" : "read",
+               s->hdr.sector);
+      s->chain = NULL;
+      if (!chain_busy (d, chain))
+        block_complete (chain);
+    }
+  issue_requests (d);
+}
+
+/* virtio-blk interrupt handler. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct vblk *d = &disks[i];
+
+      /* Reading the ISR acknowledges the interrupt. */
+      if (d->irq == f->vec_no && (inb (d->io_base + REG_ISR) & 1))
+        complete_requests (d);
+    }
+}
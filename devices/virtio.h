@@ -0,0 +1,64 @@
+#ifndef DEVICES_VIRTIO_H
+#define DEVICES_VIRTIO_H
+
+#include <stdint.h>
+
+/* Definitions shared by the drivers for legacy virtio PCI
+   devices, from the Virtio PCI Card Specification, version
+   0.9.5. */
+
+/* PCI vendor ID of virtio devices. */
+#define VIRTIO_VENDOR_ID 0x1af4
+
+/* Legacy virtio registers, relative to the I/O port in BAR 0.
+   Device-specific configuration follows, starting at 0x14. */
+#define REG_DEVICE_FEATURES 0x00  /* Features device offers (32 bits). */
+#define REG_GUEST_FEATURES 0x04   /* Features driver accepts (32 bits). */
+#define REG_QUEUE_PFN 0x08        /* Page number of selected queue. */
+#define REG_QUEUE_SIZE 0x0c       /* Entries in selected queue (16 bits). */
+#define REG_QUEUE_SELECT 0x0e     /* Queue selector (16 bits). */
+#define REG_QUEUE_NOTIFY 0x10     /* Write queue number to kick it. */
+#define REG_STATUS 0x12           /* Device status (8 bits). */
+#define REG_ISR 0x13              /* Interrupt status, cleared by read. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01   /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02        /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04     /* Driver is ready. */
+#define STATUS_FAILED 0x80        /* Driver gave up on the device. */
+
+/* A virtqueue descriptor, naming one buffer. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length of buffer. */
+    uint16_t flags;             /* VRING_DESC_F_* bits. */
+    uint16_t next;              /* Next descriptor in chain. */
+  };
+#define VRING_DESC_F_NEXT 1     /* NEXT is valid. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads, buffer. */
+
+/* Descriptor chains that the driver offers the device. */
+struct vring_avail
+  {
+    uint16_t flags;             /* VRING_AVAIL_F_* bits. */
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+#define VRING_AVAIL_F_NO_INTERRUPT 1 /* Don't interrupt on completion. */
+
+/* Descriptor chains that the device has finished with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written into chain. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+#endif /* devices/virtio.h */
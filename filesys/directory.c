@@ -8,17 +8,18 @@
 #include "threads/thread.h"
 #include "filesys/free-map.h"
 #include "threads/synch.h"
+#include <packed.h>
+#include <round.h>
 
 
 
-/* A single directory entry. */
-struct dir_entry 
-  {
-    block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
-  };
-
+static bool find_entry (struct inode *, const char *name,
+                        block_sector_t inumber, block_sector_t *sectorp,
+                        off_t *ofsp);
+static bool add_entry (struct inode *, const char *name, block_sector_t);
+static bool remove_entry (struct inode *, off_t ofs);
+static off_t rec_len (const uint8_t *buf, off_t ofs);
+static bool read_dir_sector (struct inode *, off_t base, uint8_t *buf);
 
 //changes current thread's current directory to one with name name
 bool
@@ -103,21 +104,20 @@ dir_make (char *name) {
   //name_copy is the new directory's name
   //name copy2 is the parent directory's path
 
-  struct dir_entry *entry = calloc(1, sizeof(struct dir_entry));
-  strlcpy(entry->name, name_copy, strlen(name_copy)+1);
-  free_map_allocate(1, &entry->inode_sector);
-  dir_create(entry->inode_sector, 1);
+  block_sector_t inode_sector = 0;
+  free_map_allocate_dir(&inode_sector);
+  dir_create(inode_sector, 1);
   struct dir* dir;
   if(name_copy2[0] != '\0'){
     ASSERT(dir_lookup(lookup_dir, name_copy2, &t));
     dir = dir_open(t);
-    dir_add(dir, name_copy, entry->inode_sector);
+    dir_add(dir, name_copy, inode_sector);
     dir_close(dir);
 
   }
   else{ //if the path is empty, parent is lookup_dir
     dir = lookup_dir;
-    dir_add(dir, name_copy, entry->inode_sector);
+    dir_add(dir, name_copy, inode_sector);
   }
 
   //if absolute path
@@ -125,17 +125,19 @@ dir_make (char *name) {
     dir_close(lookup_dir);
   free(name_copy2);
   free(name_copy);
-  free(entry);
   return true;
 }
 
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Returns true if successful, false on failure.
+   Directories always occupy whole sectors; dir_add() appends
+   more sectors as they fill up. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
   uint32_t is_dir = 1;
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), is_dir);
+  size_t bytes = entry_cnt * DIR_REC_LEN (NAME_MAX);
+  return inode_create (sector, ROUND_UP (bytes, BLOCK_SECTOR_SIZE), is_dir);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -193,17 +195,14 @@ dir_get_inode (struct dir *dir)
 }
 
 /* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   If successful, returns true, sets *SECTORP to the entry's inode
+   sector if SECTORP is non-null, and sets *OFSP to the byte
+   offset of the directory entry if OFSP is non-null.
+   otherwise, returns false and ignores SECTORP and OFSP. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp)
+        block_sector_t *sectorp, off_t *ofsp)
 {
-  struct dir_entry e;
-  size_t ofs;
-  
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
@@ -213,19 +212,10 @@ lookup (const struct dir *dir, const char *name,
 
       struct dir *parent = dir_open(inode_open(dir->inode->data.parent_directory));
       if(parent==NULL) parent = dir_open_root();
-      for (ofs = 0; inode_read_at (parent->inode, &e, sizeof e, ofs) == sizeof e;
-          ofs += sizeof e) 
-        if (e.in_use && dir->inode->sector == e.inode_sector) 
-        {
-          if (ep != NULL)
-            *ep = e;
-          if (ofsp != NULL)
-            *ofsp = ofs;
-          dir_close(parent);
-          return true;
-      }
-    dir_close(parent);
-    return false;
+      bool found = find_entry (parent->inode, NULL, dir->inode->sector,
+                               sectorp, ofsp);
+      dir_close(parent);
+      return found;
   }
 
   //special case for '..'
@@ -240,34 +230,14 @@ lookup (const struct dir *dir, const char *name,
         grandparent = dir_open_root();
       }
 
-      for (ofs = 0; inode_read_at (grandparent->inode, &e, sizeof e, ofs) == sizeof e;
-          ofs += sizeof e) 
-        if (e.in_use && parent->inode->sector == e.inode_sector) 
-        {
-          if (ep != NULL)
-            *ep = e;
-          if (ofsp != NULL)
-            *ofsp = ofs;
-          dir_close(parent);
-          dir_close(grandparent);
-          return true;
-      }
-    dir_close(parent);
-    dir_close(grandparent);
-    return false;
+      bool found = find_entry (grandparent->inode, NULL, parent->inode->sector,
+                               sectorp, ofsp);
+      dir_close(parent);
+      dir_close(grandparent);
+      return found;
   }
   //searches dir for the file with a matching name
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  return find_entry (dir->inode, name, 0, sectorp, ofsp);
 }
 
 
@@ -279,7 +249,7 @@ lookup (const struct dir *dir, const char *name,
 
 bool dir_lookup(const struct dir *dir, const char *name,
             struct inode **inode){
-  struct dir_entry e;
+  block_sector_t inode_sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
@@ -316,11 +286,11 @@ bool dir_lookup(const struct dir *dir, const char *name,
     if(dir->inode->rw != NULL){
       read_acquire(&directory->inode->rw);
     }
-    if (lookup (directory, token, &e, NULL)) {
+    if (lookup (directory, token, &inode_sector, NULL)) {
       if(dir->inode->rw != NULL){
         read_release(&directory->inode->rw);
       }
-      new_inode = inode_open(e.inode_sector);
+      new_inode = inode_open(inode_sector);
       dir_close(directory);
 
     }
@@ -348,8 +318,6 @@ bool dir_lookup(const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
   bool success = false;
   bool has_lock = false;
 
@@ -370,23 +338,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   write_acquire(&dir->inode->rw);
   has_lock = true;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Write the entry into the first sector with enough free space,
+     or a new sector at the end of the directory. */
+  success = add_entry (dir->inode, name, inode_sector);
 
   done:;
 
@@ -406,7 +360,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  block_sector_t inode_sector;
   struct inode *inode = NULL;
   bool success = false;
   off_t ofs;
@@ -417,14 +371,14 @@ dir_remove (struct dir *dir, const char *name)
 
   /* Find directory entry. */
   read_acquire(&dir->inode->rw);
-  if (!lookup (dir, name, &e, &ofs)){
+  if (!lookup (dir, name, &inode_sector, &ofs)){
     read_release(&dir->inode->rw);
     goto done;
   }
   read_release(&dir->inode->rw);
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (inode_sector);
   if (inode == NULL){
     goto done;
   }
@@ -436,21 +390,18 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
   }
 
-  struct dir_entry ep;
-  off_t ofsp = ofs;
   if(inode->data.is_dir) {
-    for (ofsp = 0; inode_read_at (inode, &ep, sizeof ep, ofsp) == sizeof ep;
-       ofsp += sizeof ep){ 
-    if (ep.in_use) 
+    struct dir child = { inode, 0 };
+    char child_name[NAME_MAX + 1];
+    if (dir_readdir (&child, child_name))
       {
         if (has_lock) write_release(&inode->rw);
+        inode_close (inode);
         return false;
       }
-    }
   }
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
+  if (!remove_entry (dir->inode, ofs)) {
     goto done;
   }
   /* Remove inode. */
@@ -469,16 +420,199 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  off_t base;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  if (buf == NULL)
+    return false;
+
+  /* DIR->pos is the offset of the next record to return.  Walk
+     its sector from the start, since the record there may have
+     been coalesced away since the last call. */
+  for (base = ROUND_DOWN (dir->pos, BLOCK_SECTOR_SIZE);
+       !found && read_dir_sector (dir->inode, base, buf);
+       base += BLOCK_SECTOR_SIZE)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      off_t ofs;
+
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; ofs += rec_len (buf, ofs))
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          struct dir_entry *e = (struct dir_entry *) (buf + ofs);
+          if (base + ofs < dir->pos || e->inode_sector == 0)
+            continue;
+
+          memcpy (name, e->name, e->name_len);
+          name[e->name_len] = '\0';
+          dir->pos = base + ofs + rec_len (buf, ofs);
+          found = true;
+          break;
+        }
+      if (!found)
+        dir->pos = base + BLOCK_SECTOR_SIZE;
     }
-  return false;
+  free (buf);
+  return found;
+}
+
+/* Record-level helpers. */
+
+/* Returns the length of the record at byte OFS of directory
+   sector BUF.  A zero REC_LEN only occurs in a sector that has
+   never been written, and means the rest of the sector is free. */
+static off_t
+rec_len (const uint8_t *buf, off_t ofs)
+{
+  const struct dir_entry *e = (const struct dir_entry *) (buf + ofs);
+  return e->rec_len != 0 ? e->rec_len : BLOCK_SECTOR_SIZE - ofs;
+}
+
+/* Reads the directory sector starting at byte BASE of INODE into
+   BUF.  Returns false at end of directory. */
+static bool
+read_dir_sector (struct inode *inode, off_t base, uint8_t *buf)
+{
+  return inode_read_at (inode, buf, BLOCK_SECTOR_SIZE, base)
+         == BLOCK_SECTOR_SIZE;
+}
+
+/* Searches the directory in INODE for an in-use entry named NAME
+   or, if NAME is null, for one that refers to INUMBER.
+   On success returns true, storing the entry's inode sector into
+   *SECTORP and its byte offset into *OFSP, either of which may be
+   null.  Reads each directory sector once. */
+static bool
+find_entry (struct inode *inode, const char *name, block_sector_t inumber,
+            block_sector_t *sectorp, off_t *ofsp)
+{
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  size_t name_len = name != NULL ? strlen (name) : 0;
+  off_t base;
+  bool found = false;
+
+  if (buf == NULL)
+    return false;
+
+  for (base = 0; !found && read_dir_sector (inode, base, buf);
+       base += BLOCK_SECTOR_SIZE)
+    {
+      off_t ofs;
+
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; ofs += rec_len (buf, ofs))
+        {
+          struct dir_entry *e = (struct dir_entry *) (buf + ofs);
+          if (e->inode_sector == 0)
+            continue;
+          if (name != NULL
+              ? e->name_len == name_len && !memcmp (e->name, name, name_len)
+              : e->inode_sector == inumber)
+            {
+              if (sectorp != NULL)
+                *sectorp = e->inode_sector;
+              if (ofsp != NULL)
+                *ofsp = base + ofs;
+              found = true;
+              break;
+            }
+        }
+    }
+  free (buf);
+  return found;
+}
+
+/* Adds an entry for NAME referring to INODE_SECTOR to the
+   directory in INODE.  Reuses the free space of the first sector
+   that has room for it, splitting the slack off the end of an
+   existing record, and otherwise appends a new sector. */
+static bool
+add_entry (struct inode *inode, const char *name, block_sector_t inode_sector)
+{
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  size_t name_len = strlen (name);
+  off_t need = DIR_REC_LEN (name_len);
+  struct dir_entry *new;
+  off_t base;
+  bool success;
+
+  if (buf == NULL)
+    return false;
+
+  for (base = 0; read_dir_sector (inode, base, buf); base += BLOCK_SECTOR_SIZE)
+    {
+      off_t ofs;
+
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; ofs += rec_len (buf, ofs))
+        {
+          struct dir_entry *e = (struct dir_entry *) (buf + ofs);
+          off_t len = rec_len (buf, ofs);
+          off_t used = e->inode_sector != 0 ? DIR_REC_LEN (e->name_len) : 0;
+
+          if (len - used >= need)
+            {
+              new = (struct dir_entry *) (buf + ofs + used);
+              if (used != 0)
+                e->rec_len = used;
+              new->inode_sector = inode_sector;
+              new->rec_len = len - used;
+              new->name_len = name_len;
+              memcpy (new->name, name, name_len);
+              goto write;
+            }
+        }
+    }
+
+  /* No room anywhere: start a new sector at the end. */
+  memset (buf, 0, BLOCK_SECTOR_SIZE);
+  new = (struct dir_entry *) buf;
+  new->inode_sector = inode_sector;
+  new->rec_len = BLOCK_SECTOR_SIZE;
+  new->name_len = name_len;
+  memcpy (new->name, name, name_len);
+
+ write:
+  success = inode_write_at (inode, buf, BLOCK_SECTOR_SIZE, base)
+            == BLOCK_SECTOR_SIZE;
+  free (buf);
+  return success;
+}
+
+/* Removes the entry at byte offset OFS from the directory in
+   INODE, coalescing its space into the preceding record of the
+   same sector, or marking it free if it is the first. */
+static bool
+remove_entry (struct inode *inode, off_t ofs)
+{
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  off_t base = ROUND_DOWN (ofs, BLOCK_SECTOR_SIZE);
+  off_t prev, cur;
+  bool success = false;
+
+  if (buf == NULL)
+    return false;
+  if (!read_dir_sector (inode, base, buf))
+    goto done;
+
+  /* Find the record just before the one being removed. */
+  ofs -= base;
+  for (prev = -1, cur = 0; cur < ofs; prev = cur, cur += rec_len (buf, cur))
+    continue;
+  ASSERT (cur == ofs);
+
+  if (prev >= 0)
+    {
+      struct dir_entry *p = (struct dir_entry *) (buf + prev);
+      p->rec_len = rec_len (buf, prev) + rec_len (buf, ofs);
+    }
+  else
+    {
+      struct dir_entry *e = (struct dir_entry *) (buf + ofs);
+      e->rec_len = rec_len (buf, ofs);
+      e->inode_sector = 0;
+    }
+  success = inode_write_at (inode, buf, BLOCK_SECTOR_SIZE, base)
+            == BLOCK_SECTOR_SIZE;
+
+ done:
+  free (buf);
+  return success;
 }
@@ -3,15 +3,10 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <packed.h>
 #include "devices/block.h"
-#include <stdio.h>
-#include <string.h>
-#include <list.h>
-#include "filesys/filesys.h"
-#include "filesys/inode.h"
-#include "threads/malloc.h"
-#include "threads/thread.h"
-#include "filesys/free-map.h"
+#include "filesys/off_t.h"
 
 
 /* Maximum length of a file name component.
@@ -20,7 +15,30 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 32
 
+/* A single directory entry, as stored on disk.
 
+   Entries are variable-length records packed back to back within
+   each sector of a directory; a record never straddles a sector
+   boundary.  REC_LEN chains to the next record in the same
+   sector, so the records of a sector always add up to
+   BLOCK_SECTOR_SIZE.  Any bytes between the end of the name and
+   REC_LEN are slack that dir_add() can carve a new entry out of.
+   A record with INODE_SECTOR 0 (the free map's sector, which
+   never appears in a directory) is free; this only happens to the
+   first record of a sector, since removing any later record just
+   coalesces it into its predecessor.  A sector of all zeros is
+   one free record spanning the whole sector. */
+struct dir_entry
+  {
+    block_sector_t inode_sector;        /* Sector number of header, 0 if free. */
+    uint16_t rec_len;                   /* Bytes from here to next record. */
+    uint8_t name_len;                   /* Name length, no null terminator. */
+    char name[];                        /* File name, not null terminated. */
+  }
+PACKED;
+
+/* Number of bytes a record needs to hold a NAME_LEN byte name. */
+#define DIR_REC_LEN(NAME_LEN) (offsetof (struct dir_entry, name) + (NAME_LEN))
 
 struct inode;
 
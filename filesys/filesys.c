@@ -88,7 +88,8 @@ filesys_create (const char *name, off_t initial_size)
 
   uint32_t is_dir = 0;
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_inode (inode_get_inumber (dir_get_inode (dir)),
+                                              &inode_sector)
                   && inode_create (inode_sector, initial_size, is_dir)
                   && dir_add (dir, name_copy, inode_sector));
   if (!success && inode_sector != 0) 
@@ -1,6 +1,7 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -8,6 +9,12 @@
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+static bool allocate_range (size_t cnt, size_t start, size_t end,
+                            block_sector_t *sectorp);
+static size_t group_cnt (void);
+static size_t group_start (size_t group);
+static size_t group_end (size_t group);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -27,17 +34,122 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return allocate_range (cnt, 0, bitmap_size (free_map), sectorp);
+}
+
+/* Allocates CNT consecutive data sectors as close as possible
+   after sector NEAR, preferring the data area of NEAR's
+   allocation group, and stores the first into *SECTORP.
+   Returns true if successful, false if the disk is full or the
+   free map file could not be written. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t near,
+                        block_sector_t *sectorp)
+{
+  size_t group = near / GROUP_SECTORS;
+  size_t data_start = group_start (group) + GROUP_INODE_SECTORS;
+  size_t start = near > data_start ? near : data_start;
+
+  return (allocate_range (cnt, start, group_end (group), sectorp)
+          || allocate_range (cnt, data_start, group_end (group), sectorp)
+          || allocate_range (cnt, near, bitmap_size (free_map), sectorp)
+          || free_map_allocate (cnt, sectorp));
+}
+
+/* Allocates a sector for the inode of a new file in directory
+   PARENT (the sector of the directory's inode), in the inode
+   area of PARENT's allocation group if possible, and stores it
+   into *SECTORP.  Returns true if successful, false otherwise. */
+bool
+free_map_allocate_inode (block_sector_t parent, block_sector_t *sectorp)
+{
+  size_t first = parent / GROUP_SECTORS;
+  size_t i;
+
+  for (i = 0; i < group_cnt (); i++)
+    {
+      size_t group = (first + i) % group_cnt ();
+      size_t start = group_start (group);
+      if (allocate_range (1, start, start + GROUP_INODE_SECTORS, sectorp))
+        return true;
+    }
+  return free_map_allocate_near (1, parent, sectorp);
+}
+
+/* Allocates a sector for the inode of a new directory in the
+   allocation group with the most free sectors and stores it into
+   *SECTORP.  Returns true if successful, false otherwise. */
+bool
+free_map_allocate_dir (block_sector_t *sectorp)
+{
+  size_t best = 0;
+  size_t best_free = 0;
+  size_t group;
+
+  for (group = 0; group < group_cnt (); group++)
+    {
+      size_t start = group_start (group);
+      size_t free_cnt = bitmap_count (free_map, start,
+                                      group_end (group) - start, false);
+      if (free_cnt > best_free)
+        {
+          best = group;
+          best_free = free_cnt;
+        }
+    }
+  return free_map_allocate_inode (group_start (best), sectorp);
+}
+
+/* Allocates the first run of CNT free sectors that lies entirely
+   within sectors START...END-1 and stores its first sector into
+   *SECTORP, writing the free map back to disk.  Returns true if
+   successful, false if no such run exists or the free_map file
+   could not be written. */
+static bool
+allocate_range (size_t cnt, size_t start, size_t end, block_sector_t *sectorp)
+{
+  size_t sector;
+
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  if (start >= end)
+    return false;
+
+  sector = bitmap_scan (free_map, start, cnt, false);
+  if (sector == BITMAP_ERROR || sector + cnt > end)
+    return false;
+
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      return false;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  *sectorp = sector;
+  return true;
+}
+
+/* Returns the number of allocation groups on the device. */
+static size_t
+group_cnt (void)
+{
+  return DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+}
+
+/* Returns the first sector of allocation group GROUP. */
+static size_t
+group_start (size_t group)
+{
+  return group * GROUP_SECTORS;
+}
+
+/* Returns the sector just past the end of allocation group
+   GROUP, which is short for the last group on the device. */
+static size_t
+group_end (size_t group)
+{
+  size_t end = group_start (group) + GROUP_SECTORS;
+  return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
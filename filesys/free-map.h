@@ -5,6 +5,17 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* Allocation groups.
+   The device is divided into groups of GROUP_SECTORS sectors, in
+   the style of the BSD fast file system's cylinder groups.  The
+   first GROUP_INODE_SECTORS of each group are preferred for
+   inodes, so that the inodes of one directory sit next to each
+   other, and file data is allocated from the rest of the group
+   near its inode.  New directories go in the group with the most
+   free space, which spreads unrelated trees across the disk. */
+#define GROUP_SECTORS 1024
+#define GROUP_INODE_SECTORS 128
+
 void free_map_init (void);
 void free_map_read (void);
 void free_map_create (void);
@@ -12,6 +23,9 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (size_t, block_sector_t near, block_sector_t *);
+bool free_map_allocate_inode (block_sector_t parent, block_sector_t *);
+bool free_map_allocate_dir (block_sector_t *);
 void free_map_release (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,10 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/hostfs.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -67,27 +70,146 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Number of pages of scratch device data that fsutil_extract()
+   reads ahead, and fsutil_append() writes behind, at a time. */
+#define EXTRACT_PAGES 16
+
+/* Sectors in each half of the read-ahead buffer. */
+#define STREAM_SECTORS (EXTRACT_PAGES / 2 * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A sequential reader over the scratch device.  Its buffer is
+   split in two halves: while the caller consumes one, a block
+   request fills the other, so that the device keeps busy while
+   extracted files are written out. */
+struct scratch_stream
+  {
+    struct block *block;        /* Scratch device. */
+    block_sector_t next;        /* Next sector to request from BLOCK. */
+    uint8_t *buffer;            /* Read-ahead buffer, EXTRACT_PAGES pages. */
+    struct block_request requests[2];   /* Request for each half. */
+    block_sector_t starts[2];   /* First sector of each half in BLOCK. */
+    struct semaphore done[2];   /* Up'd when each request completes. */
+    int cur;                    /* Half being consumed. */
+    size_t sector_ofs;          /* Sectors of current half consumed. */
+  };
+
+/* Starts filling half HALF of STREAM's buffer with the next
+   sectors from the device.  At the end of the device, leaves
+   the half empty. */
+static void
+stream_fill (struct scratch_stream *s, int half)
+{
+  struct block_request *r = &s->requests[half];
+  block_sector_t cnt = block_size (s->block) - s->next;
+
+  if (cnt > STREAM_SECTORS)
+    cnt = STREAM_SECTORS;
+  block_request_init (r, s->block, false, s->next, cnt,
+                      s->buffer + half * STREAM_SECTORS * BLOCK_SECTOR_SIZE);
+  r->done = &s->done[half];
+  s->starts[half] = s->next;
+  s->next += cnt;
+  if (cnt > 0)
+    block_submit (r);
+  else
+    sema_up (r->done);
+}
+
+/* Opens STREAM for reading BLOCK starting at sector START. */
+static void
+stream_open (struct scratch_stream *s, struct block *block,
+             block_sector_t start)
+{
+  s->block = block;
+  s->next = start;
+  s->buffer = palloc_get_multiple (0, EXTRACT_PAGES);
+  if (s->buffer == NULL)
+    PANIC ("couldn't allocate buffers");
+  sema_init (&s->done[0], 0);
+  sema_init (&s->done[1], 0);
+  stream_fill (s, 0);
+  stream_fill (s, 1);
+  s->cur = 0;
+  s->sector_ofs = 0;
+  sema_down (&s->done[0]);
+}
+
+/* Waits for STREAM's outstanding read-ahead and frees its
+   buffer. */
+static void
+stream_close (struct scratch_stream *s)
+{
+  sema_down (&s->done[!s->cur]);
+  palloc_free_multiple (s->buffer, EXTRACT_PAGES);
+}
+
+/* Returns up to MAX_CNT consecutive sectors from STREAM, storing
+   the number returned into *CNT.  The data stays valid until the
+   next call.  Panics at end of device. */
+static void *
+stream_read (struct scratch_stream *s, size_t max_cnt, size_t *cnt)
+{
+  struct block_request *r = &s->requests[s->cur];
+
+  if (s->sector_ofs == r->sector_cnt)
+    {
+      /* Current half is used up: start refilling it and switch
+         to the other one. */
+      stream_fill (s, s->cur);
+      s->cur = !s->cur;
+      s->sector_ofs = 0;
+      r = &s->requests[s->cur];
+      sema_down (&s->done[s->cur]);
+      if (r->sector_cnt == 0)
+        PANIC ("ustar archive runs past end of scratch device");
+    }
+
+  *cnt = r->sector_cnt - s->sector_ofs;
+  if (*cnt > max_cnt)
+    *cnt = max_cnt;
+  s->sector_ofs += *cnt;
+  return (uint8_t *) r->buffer + (s->sector_ofs - *cnt) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the scratch device sector number of the next sector
+   that stream_read() will return.  This comes from the stream's
+   own record of where each half starts, because the block layer
+   may rewrite a request's sector number, e.g. to a sector on the
+   whole disk when the scratch device is a partition. */
+static block_sector_t
+stream_tell (const struct scratch_stream *s)
+{
+  return s->starts[s->cur] + s->sector_ofs;
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   The archive is streamed off the device EXTRACT_PAGES / 2
+   pages at a time, with the next chunk read ahead.  Each file is
+   created at its full size from its ustar header, so its sectors
+   are allocated together up front, and then written with as few
+   file_write() calls as the read-ahead buffer allows. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
+  struct scratch_stream s;
   struct block *src;
-  void *header, *data;
-
-  /* Allocate buffers. */
-  header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+  void *header;
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
   if (src == NULL)
     PANIC ("couldn't open scratch device");
 
+  /* Allocate buffers. */
+  header = malloc (BLOCK_SECTOR_SIZE);
+  if (header == NULL)
+    PANIC ("couldn't allocate buffers");
+  stream_open (&s, src, sector);
+
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
 
@@ -96,13 +218,15 @@ fsutil_extract (char **argv UNUSED)
       const char *file_name;
       const char *error;
       enum ustar_type type;
+      size_t cnt;
       int size;
 
       /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      memcpy (header, stream_read (&s, 1, &cnt), BLOCK_SECTOR_SIZE);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header in sector %"PRDSNu" (%s)",
+               stream_tell (&s) - 1, error);
 
       if (type == USTAR_EOF)
         {
@@ -117,20 +241,23 @@ fsutil_extract (char **argv UNUSED)
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
+          /* Create destination file, preallocated to its final
+             size so that writing never has to grow it. */
           if (!filesys_create (file_name, size))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, a buffer's worth of sectors at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              void *data = stream_read (&s, DIV_ROUND_UP (size,
+                                                          BLOCK_SECTOR_SIZE),
+                                        &cnt);
+              int chunk_size = cnt * BLOCK_SECTOR_SIZE;
+              if (chunk_size > size)
+                chunk_size = size;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -141,6 +268,8 @@ fsutil_extract (char **argv UNUSED)
           file_close (dst);
         }
     }
+  sector = stream_tell (&s);
+  stream_close (&s);
 
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
@@ -151,7 +280,6 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
   free (header);
 }
 
@@ -170,6 +298,9 @@ fsutil_append (char **argv)
 
   const char *file_name = argv[1];
   void *buffer;
+  struct block_request requests[2];
+  struct semaphore done[2];
+  int cur;
   struct file *src;
   struct block *dst;
   off_t size;
@@ -177,7 +308,7 @@ fsutil_append (char **argv)
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  buffer = palloc_get_multiple (0, EXTRACT_PAGES);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -197,18 +328,36 @@ fsutil_append (char **argv)
     PANIC ("%s: name too long for ustar format", file_name);
   block_write (dst, sector++, buffer);
 
-  /* Do copy. */
-  while (size > 0) 
+  /* Do copy, half a buffer at a time.  While one half is being
+     written to the scratch device, the other is filled from the
+     file, so that the file system and scratch devices (ideally on
+     different IDE channels) are busy at the same time. */
+  sema_init (&done[0], 1);
+  sema_init (&done[1], 1);
+  for (cur = 0; size > 0; cur = !cur)
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      uint8_t *half = (uint8_t *) buffer + (cur * STREAM_SECTORS
+                                            * BLOCK_SECTOR_SIZE);
+      off_t chunk_size = (size > STREAM_SECTORS * BLOCK_SECTOR_SIZE
+                          ? STREAM_SECTORS * BLOCK_SECTOR_SIZE : size);
+      block_sector_t cnt = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+      if (sector + cnt > block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
+
+      /* Wait for this half's previous write to finish. */
+      sema_down (&done[cur]);
+      if (file_read (src, half, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (half + chunk_size, 0, cnt * BLOCK_SECTOR_SIZE - chunk_size);
+
+      block_request_init (&requests[cur], dst, true, sector, cnt, half);
+      requests[cur].done = &done[cur];
+      block_submit (&requests[cur]);
+      sector += cnt;
       size -= chunk_size;
     }
+  sema_down (&done[0]);
+  sema_down (&done[1]);
 
   /* Write ustar end-of-archive marker, which is two consecutive
      sectors full of zeros.  Don't advance our position past
@@ -219,5 +368,85 @@ fsutil_append (char **argv)
 
   /* Finish up. */
   file_close (src);
-  free (buffer);
+  palloc_free_multiple (buffer, EXTRACT_PAGES);
+}
+
+/* Copies the file named ARGV[1] in the host directory into the
+   file system under the same name. */
+void
+fsutil_import (char **argv)
+{
+  const char *file_name = argv[1];
+  struct hostfs_file *src;
+  struct file *dst;
+  void *buffer;
+  off_t size, ofs;
+
+  printf ("Importing '%s' from host directory...\n", file_name);
+
+  src = hostfs_open (file_name);
+  if (src == NULL)
+    PANIC ("%s: open failed on host", file_name);
+  size = hostfs_length (src);
+  if (size < 0)
+    PANIC ("%s: couldn't get size on host", file_name);
+  if (!filesys_create (file_name, size))
+    PANIC ("%s: create failed", file_name);
+  dst = filesys_open (file_name);
+  if (dst == NULL)
+    PANIC ("%s: open failed", file_name);
+
+  buffer = palloc_get_multiple (PAL_ASSERT, EXTRACT_PAGES);
+  for (ofs = 0; ofs < size; )
+    {
+      off_t chunk_size = (size - ofs < EXTRACT_PAGES * PGSIZE
+                          ? size - ofs : EXTRACT_PAGES * PGSIZE);
+      if (hostfs_read_at (src, buffer, chunk_size, ofs) != chunk_size)
+        PANIC ("%s: read failed on host", file_name);
+      if (file_write (dst, buffer, chunk_size) != chunk_size)
+        PANIC ("%s: write failed", file_name);
+      ofs += chunk_size;
+    }
+  palloc_free_multiple (buffer, EXTRACT_PAGES);
+
+  file_close (dst);
+  hostfs_close (src);
+}
+
+/* Copies the file named ARGV[1] in the file system into the host
+   directory under the same name. */
+void
+fsutil_export (char **argv)
+{
+  const char *file_name = argv[1];
+  struct file *src;
+  struct hostfs_file *dst;
+  void *buffer;
+  off_t size, ofs;
+
+  printf ("Exporting '%s' to host directory...\n", file_name);
+
+  src = filesys_open (file_name);
+  if (src == NULL)
+    PANIC ("%s: open failed", file_name);
+  size = file_length (src);
+  dst = hostfs_create (file_name);
+  if (dst == NULL)
+    PANIC ("%s: create failed on host", file_name);
+
+  buffer = palloc_get_multiple (PAL_ASSERT, EXTRACT_PAGES);
+  for (ofs = 0; ofs < size; )
+    {
+      off_t chunk_size = (size - ofs < EXTRACT_PAGES * PGSIZE
+                          ? size - ofs : EXTRACT_PAGES * PGSIZE);
+      if (file_read (src, buffer, chunk_size) != chunk_size)
+        PANIC ("%s: read failed", file_name);
+      if (hostfs_write_at (dst, buffer, chunk_size, ofs) != chunk_size)
+        PANIC ("%s: write failed on host", file_name);
+      ofs += chunk_size;
+    }
+  palloc_free_multiple (buffer, EXTRACT_PAGES);
+
+  hostfs_close (dst);
+  file_close (src);
 }
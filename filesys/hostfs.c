@@ -0,0 +1,541 @@
+#include "filesys/hostfs.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/virtio-9p.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The code in this file is a client for the 9P2000.L protocol,
+   which lets the kernel open, read, and write files in a
+   directory that the host exports through the virtio-9p device
+   (see devices/virtio-9p.c).  This is the quick way to move bulk
+   data in and out of the machine: file data travels by memory
+   copy between host and guest, instead of through a disk image
+   that the pintos script must build and pick apart.
+
+   9P names files with "fids", numbers chosen by the client.  Fid
+   ROOT_FID is the exported directory itself, and every open file
+   gets a fid of its own by walking from there.  Messages are
+   little-endian, like the 80x86, so fields are simply copied in
+   and out of them.
+
+   Only one request is outstanding at a time, so a single pair of
+   message buffers serves all of them, under hostfs_lock.  Bulk
+   data goes straight between the device and the caller's buffer
+   without being copied here. */
+
+/* 9P2000.L message types. */
+#define RLERROR 7
+#define TLOPEN 12
+#define RLOPEN 13
+#define TLCREATE 14
+#define RLCREATE 15
+#define TGETATTR 24
+#define RGETATTR 25
+#define TVERSION 100
+#define RVERSION 101
+#define TATTACH 104
+#define RATTACH 105
+#define TWALK 110
+#define RWALK 111
+#define TREAD 116
+#define RREAD 117
+#define TWRITE 118
+#define RWRITE 119
+#define TCLUNK 120
+#define RCLUNK 121
+
+#define NOTAG 0xffff            /* Tag for Tversion. */
+#define NOFID 0xffffffff        /* No fid. */
+#define ROOT_FID 0              /* Fid of the exported directory. */
+
+#define HDR_SIZE 7              /* size[4] type[1] tag[2]. */
+#define QID_SIZE 13             /* type[1] version[4] path[8]. */
+#define IO_HDR_SIZE 24          /* Largest Tread, Rread, Twrite, Rwrite
+                                   header. */
+#define MSG_MAX 512             /* Largest message without bulk data. */
+#define NAME_MAX 255            /* Longest file name component. */
+
+/* Message size we ask the host for.  Bigger messages mean fewer
+   round trips for bulk data. */
+#define MSIZE (128 * 1024)
+
+/* Linux open() flags, which 9P2000.L uses. */
+#define L_O_RDONLY 0
+#define L_O_WRONLY 01
+#define L_O_CREAT 0100
+#define L_O_TRUNC 01000
+
+/* Tgetattr request mask bit for the file size. */
+#define GETATTR_SIZE 0x200
+
+/* An open file on the host. */
+struct hostfs_file
+  {
+    uint32_t fid;               /* 9P fid. */
+  };
+
+/* A 9P message. */
+struct msg
+  {
+    uint8_t buf[MSG_MAX];       /* Contents. */
+    size_t len;                 /* Bytes written, or read so far. */
+    size_t end;                 /* Bytes received, in a reply. */
+  };
+
+/* Whether the host directory is available, and the most bulk
+   data that fits in one message. */
+static bool mounted;
+static size_t iounit;
+
+/* Request and reply buffers and the next fid to hand out.
+   Protected by hostfs_lock. */
+static struct msg tmsg, rmsg;
+static uint32_t next_fid = ROOT_FID + 1;
+static struct lock hostfs_lock;
+
+static void begin (uint8_t type);
+static void put (const void *, size_t);
+static void put_u16 (uint16_t);
+static void put_u32 (uint32_t);
+static void put_u64 (uint64_t);
+static void put_str (const char *, size_t len);
+static void get (void *, size_t);
+static uint16_t get_u16 (void);
+static uint32_t get_u32 (void);
+static uint64_t get_u64 (void);
+static bool rpc (uint8_t rtype, const void *out, size_t out_size,
+                 void *in, size_t in_size);
+static uint32_t walk (const char *name, size_t len);
+static void clunk (uint32_t fid);
+static struct hostfs_file *make_file (uint32_t fid);
+
+/* Connects to the host directory exported through the virtio-9p
+   device, if there is one. */
+void
+hostfs_init (void)
+{
+  char version[16];
+  uint32_t msize;
+  uint16_t len;
+
+  lock_init (&hostfs_lock);
+  if (!virtio_9p_present ())
+    return;
+
+  begin (TVERSION);
+  put_u32 (MSIZE);
+  put_str ("9P2000.L", strlen ("9P2000.L"));
+  if (!rpc (RVERSION, NULL, 0, NULL, 0))
+    {
+      printf ("hostfs: version negotiation failed\n");
+      return;
+    }
+  msize = get_u32 ();
+  len = get_u16 ();
+  if (len >= sizeof version || msize <= IO_HDR_SIZE || msize > MSIZE)
+    len = 0;
+  get (version, len);
+  version[len] = '\0';
+  if (strcmp (version, "9P2000.L"))
+    {
+      printf ("hostfs: host does not speak 9P2000.L\n");
+      return;
+    }
+  iounit = msize - IO_HDR_SIZE;
+
+  begin (TATTACH);
+  put_u32 (ROOT_FID);
+  put_u32 (NOFID);
+  put_str ("pintos", strlen ("pintos"));
+  put_str ("", 0);
+  put_u32 (0);
+  if (!rpc (RATTACH, NULL, 0, NULL, 0))
+    {
+      printf ("hostfs: attach failed\n");
+      return;
+    }
+
+  mounted = true;
+  printf ("hostfs: host directory attached, %zu-byte transfers\n", iounit);
+}
+
+/* Returns true if the host directory is available. */
+bool
+hostfs_mounted (void)
+{
+  return mounted;
+}
+
+/* Opens the file with the given NAME, relative to the host
+   directory, for reading.  Returns the new file if successful,
+   or a null pointer otherwise. */
+struct hostfs_file *
+hostfs_open (const char *name)
+{
+  struct hostfs_file *file = NULL;
+  uint32_t fid;
+
+  if (!mounted)
+    return NULL;
+
+  lock_acquire (&hostfs_lock);
+  fid = walk (name, strlen (name));
+  if (fid != NOFID)
+    {
+      begin (TLOPEN);
+      put_u32 (fid);
+      put_u32 (L_O_RDONLY);
+      if (rpc (RLOPEN, NULL, 0, NULL, 0))
+        file = make_file (fid);
+      else
+        clunk (fid);
+    }
+  lock_release (&hostfs_lock);
+
+  return file;
+}
+
+/* Creates a file with the given NAME, relative to the host
+   directory, or truncates it if it already exists, and opens it
+   for writing.  The directory that is to contain it must already
+   exist.  Returns the new file if successful, or a null pointer
+   otherwise. */
+struct hostfs_file *
+hostfs_create (const char *name)
+{
+  struct hostfs_file *file = NULL;
+  const char *base;
+  uint32_t fid;
+
+  if (!mounted)
+    return NULL;
+  base = strrchr (name, '/');
+  base = base != NULL ? base + 1 : name;
+  if (*base == '\0' || strlen (base) > NAME_MAX)
+    return NULL;
+
+  lock_acquire (&hostfs_lock);
+  fid = walk (name, base - name);
+  if (fid != NOFID)
+    {
+      /* On success, FID becomes the new file. */
+      begin (TLCREATE);
+      put_u32 (fid);
+      put_str (base, strlen (base));
+      put_u32 (L_O_WRONLY | L_O_CREAT | L_O_TRUNC);
+      put_u32 (0644);
+      put_u32 (0);
+      if (rpc (RLCREATE, NULL, 0, NULL, 0))
+        file = make_file (fid);
+      else
+        clunk (fid);
+    }
+  lock_release (&hostfs_lock);
+
+  return file;
+}
+
+/* Closes FILE. */
+void
+hostfs_close (struct hostfs_file *file)
+{
+  if (file != NULL)
+    {
+      lock_acquire (&hostfs_lock);
+      clunk (file->fid);
+      lock_release (&hostfs_lock);
+      free (file);
+    }
+}
+
+/* Returns the size of FILE in bytes, or -1 if it cannot be
+   found out. */
+off_t
+hostfs_length (struct hostfs_file *file)
+{
+  off_t length = -1;
+
+  lock_acquire (&hostfs_lock);
+  begin (TGETATTR);
+  put_u32 (file->fid);
+  put_u64 (GETATTR_SIZE);
+  if (rpc (RGETATTR, NULL, 0, NULL, 0))
+    {
+      uint8_t skip[8 + QID_SIZE + 4 + 4 + 4 + 8 + 8];
+      uint64_t size;
+
+      /* Skip valid, qid, mode, uid, gid, nlink, rdev. */
+      get (skip, sizeof skip);
+      size = get_u64 ();
+      if (size <= INT32_MAX)
+        length = size;
+    }
+  lock_release (&hostfs_lock);
+
+  return length;
+}
+
+/* Reads SIZE bytes from FILE into BUFFER, which must be in
+   kernel memory, starting at offset OFFSET in the file.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if end of file is reached or an error occurs. */
+off_t
+hostfs_read_at (struct hostfs_file *file, void *buffer_, off_t size,
+                off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  lock_acquire (&hostfs_lock);
+  while (size > 0)
+    {
+      size_t chunk_size = (size_t) size < iounit ? (size_t) size : iounit;
+      uint32_t cnt;
+
+      begin (TREAD);
+      put_u32 (file->fid);
+      put_u64 (offset);
+      put_u32 (chunk_size);
+      if (!rpc (RREAD, NULL, 0, buffer, chunk_size))
+        break;
+      cnt = get_u32 ();
+      if (cnt == 0 || cnt > chunk_size)
+        break;
+
+      size -= cnt;
+      offset += cnt;
+      buffer += cnt;
+      bytes_read += cnt;
+    }
+  lock_release (&hostfs_lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER, which must be in kernel memory,
+   into FILE, starting at offset OFFSET in the file.  Returns the
+   number of bytes actually written, which may be less than SIZE
+   if an error occurs. */
+off_t
+hostfs_write_at (struct hostfs_file *file, const void *buffer_, off_t size,
+                 off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  lock_acquire (&hostfs_lock);
+  while (size > 0)
+    {
+      size_t chunk_size = (size_t) size < iounit ? (size_t) size : iounit;
+      uint32_t cnt;
+
+      begin (TWRITE);
+      put_u32 (file->fid);
+      put_u64 (offset);
+      put_u32 (chunk_size);
+      if (!rpc (RWRITE, buffer, chunk_size, NULL, 0))
+        break;
+      cnt = get_u32 ();
+      if (cnt == 0 || cnt > chunk_size)
+        break;
+
+      size -= cnt;
+      offset += cnt;
+      buffer += cnt;
+      bytes_written += cnt;
+    }
+  lock_release (&hostfs_lock);
+
+  return bytes_written;
+}
+
+/* Starts building a request of the given TYPE in `tmsg'. */
+static void
+begin (uint8_t type)
+{
+  uint16_t tag = type == TVERSION ? NOTAG : 1;
+
+  tmsg.buf[4] = type;
+  memcpy (tmsg.buf + 5, &tag, sizeof tag);
+  tmsg.len = HDR_SIZE;
+}
+
+/* Appends the SIZE bytes in DATA to `tmsg'. */
+static void
+put (const void *data, size_t size)
+{
+  ASSERT (tmsg.len + size <= MSG_MAX);
+  memcpy (tmsg.buf + tmsg.len, data, size);
+  tmsg.len += size;
+}
+
+static void
+put_u16 (uint16_t x)
+{
+  put (&x, sizeof x);
+}
+
+static void
+put_u32 (uint32_t x)
+{
+  put (&x, sizeof x);
+}
+
+static void
+put_u64 (uint64_t x)
+{
+  put (&x, sizeof x);
+}
+
+/* Appends the LEN-byte string S to `tmsg'. */
+static void
+put_str (const char *s, size_t len)
+{
+  put_u16 (len);
+  put (s, len);
+}
+
+/* Copies the next SIZE bytes of `rmsg' into DATA, zero-filling
+   whatever is missing from a short reply. */
+static void
+get (void *data, size_t size)
+{
+  size_t avail = rmsg.end - rmsg.len;
+
+  if (size > avail)
+    {
+      memset ((uint8_t *) data + avail, 0, size - avail);
+      size = avail;
+    }
+  memcpy (data, rmsg.buf + rmsg.len, size);
+  rmsg.len += size;
+}
+
+static uint16_t
+get_u16 (void)
+{
+  uint16_t x;
+  get (&x, sizeof x);
+  return x;
+}
+
+static uint32_t
+get_u32 (void)
+{
+  uint32_t x;
+  get (&x, sizeof x);
+  return x;
+}
+
+static uint64_t
+get_u64 (void)
+{
+  uint64_t x;
+  get (&x, sizeof x);
+  return x;
+}
+
+/* Sends the request in `tmsg', followed by the OUT_SIZE bytes of
+   bulk data in OUT, and receives the reply into `rmsg'.  If IN
+   is nonnull, then only the reply's header goes into `rmsg', and
+   its bulk data goes into the IN_SIZE bytes at IN.  Returns true
+   if the reply has type RTYPE, false if it reports an error. */
+static bool
+rpc (uint8_t rtype, const void *out, size_t out_size,
+     void *in, size_t in_size)
+{
+  struct virtio_9p_buf bufs[VIRTIO_9P_MAX_BUFS];
+  size_t out_cnt = 0, in_cnt = 0;
+  uint32_t size = tmsg.len + out_size;
+  size_t reply_size;
+
+  memcpy (tmsg.buf, &size, sizeof size);
+  bufs[out_cnt++] = (struct virtio_9p_buf) {tmsg.buf, tmsg.len};
+  if (out != NULL)
+    bufs[out_cnt++] = (struct virtio_9p_buf) {(void *) out, out_size};
+  bufs[out_cnt + in_cnt++]
+    = (struct virtio_9p_buf) {rmsg.buf, in != NULL ? HDR_SIZE + 4 : MSG_MAX};
+  if (in != NULL)
+    bufs[out_cnt + in_cnt++] = (struct virtio_9p_buf) {in, in_size};
+
+  reply_size = virtio_9p_transact (bufs, out_cnt, in_cnt);
+  rmsg.end = reply_size < bufs[out_cnt].size ? reply_size : bufs[out_cnt].size;
+  rmsg.len = HDR_SIZE;
+  return rmsg.end >= HDR_SIZE && rmsg.buf[4] == rtype;
+}
+
+/* Walks from the host directory along the path in the first LEN
+   bytes of NAME, and returns a new fid for the file there, or
+   NOFID if there is no such file. */
+static uint32_t
+walk (const char *name, size_t len)
+{
+  uint32_t fid = next_fid++;
+
+  /* Start with a copy of the root fid. */
+  begin (TWALK);
+  put_u32 (ROOT_FID);
+  put_u32 (fid);
+  put_u16 (0);
+  if (!rpc (RWALK, NULL, 0, NULL, 0))
+    return NOFID;
+
+  /* Walk one component at a time, so that a long path never
+     overflows a message. */
+  while (len > 0)
+    {
+      size_t n;
+
+      if (*name == '/')
+        {
+          name++;
+          len--;
+          continue;
+        }
+      for (n = 0; n < len && name[n] != '/'; n++)
+        continue;
+
+      if (n > NAME_MAX)
+        goto error;
+      begin (TWALK);
+      put_u32 (fid);
+      put_u32 (fid);
+      put_u16 (1);
+      put_str (name, n);
+      if (!rpc (RWALK, NULL, 0, NULL, 0) || get_u16 () != 1)
+        goto error;
+
+      name += n;
+      len -= n;
+    }
+  return fid;
+
+ error:
+  clunk (fid);
+  return NOFID;
+}
+
+/* Tells the host that we are done with FID. */
+static void
+clunk (uint32_t fid)
+{
+  begin (TCLUNK);
+  put_u32 (fid);
+  rpc (RCLUNK, NULL, 0, NULL, 0);
+}
+
+/* Returns a new file for FID, clunking FID if memory runs out. */
+static struct hostfs_file *
+make_file (uint32_t fid)
+{
+  struct hostfs_file *file = malloc (sizeof *file);
+
+  if (file != NULL)
+    file->fid = fid;
+  else
+    clunk (fid);
+  return file;
+}
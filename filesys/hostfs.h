@@ -0,0 +1,19 @@
+#ifndef FILESYS_HOSTFS_H
+#define FILESYS_HOSTFS_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct hostfs_file;
+
+void hostfs_init (void);
+bool hostfs_mounted (void);
+struct hostfs_file *hostfs_open (const char *name);
+struct hostfs_file *hostfs_create (const char *name);
+void hostfs_close (struct hostfs_file *);
+off_t hostfs_length (struct hostfs_file *);
+off_t hostfs_read_at (struct hostfs_file *, void *, off_t size, off_t ofs);
+off_t hostfs_write_at (struct hostfs_file *, const void *, off_t size,
+                       off_t ofs);
+
+#endif /* filesys/hostfs.h */
@@ -10,14 +10,6 @@
 
 
 
-//a block used to store sectors
-struct indirection_block
-  {
-    int length;                         /* number of allocated sectors*/
-    block_sector_t sectors[TABLE_SIZE];        /* array of sectors */
-  };
-
-
 int byte_to_i_block(off_t pos){
   return pos / (TABLE_SIZE * BLOCK_SECTOR_SIZE);
 }
@@ -42,7 +34,9 @@ bool add_sector(block_sector_t sector){
   block_read(fs_device, sector, ind);
   ASSERT(ind->length <= TABLE_SIZE);
   ASSERT(ind->length != TABLE_SIZE);
-  if(!free_map_allocate (1, &ind->sectors[ind->length])) {
+  //place each data sector right after the previous one if possible
+  block_sector_t near = ind->length > 0 ? ind->sectors[ind->length-1] : sector;
+  if(!free_map_allocate_near (1, near, &ind->sectors[ind->length])) {
     free(ind);
     return false;
   }
@@ -83,26 +77,34 @@ bytes_to_sectors (off_t size)
 
 
 
+/* One indirection block, cached by byte_to_sector() for the
+   duration of a single inode_read_at() or inode_write_at() call,
+   so that a multi-sector transfer reads each indirection block
+   once rather than once per sector. */
+struct table_cache
+  {
+    block_sector_t sector;              /* Cached block's sector, or 0. */
+    struct indirection_block table;     /* Its contents. */
+  };
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, looking up the indirection block through CACHE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (const struct inode *inode, off_t pos, struct table_cache *cache)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length){
 
     block_sector_t t = inode->data.indirection[pos / (TABLE_SIZE * BLOCK_SECTOR_SIZE)];
-    struct indirection_block *table;
-    table = calloc(1, sizeof *table);
-    block_read(fs_device, t, table);
+    if (cache->sector != t) {
+      block_read(fs_device, t, &cache->table);
+      cache->sector = t;
+    }
 
     int index = (pos / BLOCK_SECTOR_SIZE) % TABLE_SIZE;
-    block_sector_t result = table->sectors[index];
-
-    free(table);
-    return result;
+    return cache->table.sectors[index];
   }
   else {
     return -1;
@@ -143,7 +145,7 @@ bool grow_inode(struct inode *inode, int growth){
 
   //grows in new indirection block
 
-  if(!free_map_allocate(1, &inode->data.indirection[byte_to_i_block(inode->data.length + growth - 1)])){
+  if(!free_map_allocate_near(1, inode->sector, &inode->data.indirection[byte_to_i_block(inode->data.length + growth - 1)])){
     return false;
   }
 
@@ -181,7 +183,7 @@ inode_create (block_sector_t sector, off_t length, uint32_t is_dir)
       int i;
       int num_tables = sectors / TABLE_SIZE;
       for (i=0; i<num_tables; i++) {
-        if (!free_map_allocate (1, &disk_inode->indirection[i])) {
+        if (!free_map_allocate_near (1, sector, &disk_inode->indirection[i])) {
           free (disk_inode);
           return false;
 
@@ -196,7 +198,7 @@ inode_create (block_sector_t sector, off_t length, uint32_t is_dir)
       }
 
 
-      if (!free_map_allocate (1, &disk_inode->indirection[i])) {
+      if (!free_map_allocate_near (1, sector, &disk_inode->indirection[i])) {
         free (disk_inode);
         return false;
       }
@@ -326,12 +328,15 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
+  struct table_cache *cache = calloc (1, sizeof *cache);
 
+  if (cache == NULL)
+    return 0;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, cache);
       if (sector_idx==-1)
         break;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -371,6 +376,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
   free (bounce);
+  free (cache);
   return bytes_read;
 }
 
@@ -386,6 +392,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  struct table_cache *cache;
 
   if (inode->deny_write_cnt){
     return 0;
@@ -402,6 +409,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     }
   }
 
+  cache = calloc (1, sizeof *cache);
+  if (cache == NULL)
+    return 0;
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
@@ -416,7 +427,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, cache);
       if (sector_idx==-1)
         break;
 
@@ -455,6 +466,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
   free (bounce);
+  free (cache);
   return bytes_written;
 }
 
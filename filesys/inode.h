@@ -30,6 +30,14 @@ struct inode_disk
     unsigned magic;                     /* Magic number. */
   };
 
+//a block used to store sectors
+//Must be exactly BLOCK_SECTOR_SIZE bytes long.
+struct indirection_block
+  {
+    int length;                         /* number of allocated sectors*/
+    block_sector_t sectors[TABLE_SIZE];        /* array of sectors */
+  };
+
 
 /* In-memory inode. */
 struct inode 
@@ -182,3 +182,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+iostats (struct iostats *stats)
+{
+  return syscall1 (SYS_IOSTATS, stats);
+}
+
+bool
+blockstats (const char *device, struct blockstats *stats)
+{
+  return syscall2 (SYS_BLOCKSTATS, device, stats);
+}
+
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
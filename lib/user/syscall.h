@@ -19,6 +19,38 @@ typedef int mapid_t;
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Snapshot of the timer and of file system device activity,
+   returned by iostats(). */
+struct iostats
+  {
+    long long ticks;                /* Timer ticks since boot. */
+    unsigned long long reads;       /* Sectors read from file system disk. */
+    unsigned long long writes;      /* Sectors written to file system disk. */
+  };
+
+/* Buckets in the latency histograms of struct blockstats. */
+#define BLOCKSTATS_TICK_BUCKETS 16
+#define BLOCKSTATS_TSC_BUCKETS 40
+
+/* Activity of a block device since boot, returned by
+   blockstats().  Latency runs from submission to completion of
+   a request.  Histogram bucket 0 counts requests with a latency
+   of 0, and bucket I > 0 those with a latency from 2**(I-1) up
+   to 2**I, except that the last bucket has no upper limit. */
+struct blockstats
+  {
+    unsigned long long read_bytes;      /* Bytes read. */
+    unsigned long long write_bytes;     /* Bytes written. */
+    unsigned long long sequential_cnt;  /* Requests that started where
+                                           the previous one ended. */
+    unsigned long long random_cnt;      /* Other requests. */
+    unsigned long long complete_cnt;    /* Requests completed. */
+    unsigned long long busy_tsc;        /* CPU cycles that the device
+                                           had requests outstanding. */
+    unsigned long long latency_ticks[BLOCKSTATS_TICK_BUCKETS];
+    unsigned long long latency_tsc[BLOCKSTATS_TSC_BUCKETS];
+  };
+
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
@@ -45,4 +77,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Performance measurement. */
+bool iostats (struct iostats *);
+bool blockstats (const char *device, struct blockstats *);
+
+/* Virtual memory extensions. */
+pid_t fork (void);
+
 #endif /* lib/user/syscall.h */
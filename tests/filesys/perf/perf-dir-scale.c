@@ -0,0 +1,55 @@
+/* Measures how lookup cost scales with directory size: grows a
+   directory to successively larger sizes and, at each size,
+   times lookups of randomly chosen entries. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/perf/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LOOKUP_CNT 200
+
+static const int sizes[] = {16, 64, 256};
+
+void
+test_main (void)
+{
+  char name[sizeof "entry-2147483648"];  /* Widest name printed. */
+  char metric[32];
+  struct perf p;
+  size_t i;
+  int entry_cnt = 0;
+
+  random_init (0);
+  CHECK (mkdir ("scale"), "mkdir \"scale\"");
+  CHECK (chdir ("scale"), "chdir \"scale\"");
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      int j;
+
+      /* Grow the directory, untimed. */
+      for (; entry_cnt < sizes[i]; entry_cnt++)
+        {
+          snprintf (name, sizeof name, "entry%d", entry_cnt);
+          if (!create (name, 0))
+            fail ("create \"%s\" failed", name);
+        }
+
+      snprintf (metric, sizeof metric, "dir-lookup-%d", entry_cnt);
+      perf_begin (&p, metric);
+      for (j = 0; j < LOOKUP_CNT; j++)
+        {
+          int fd;
+
+          snprintf (name, sizeof name, "entry%lu",
+                    random_ulong () % entry_cnt);
+          if ((fd = open (name)) < 2)
+            fail ("open \"%s\" failed", name);
+          close (fd);
+        }
+      perf_end (&p, LOOKUP_CNT, 0);
+    }
+}
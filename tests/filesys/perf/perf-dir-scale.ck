@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::perf::perf;
+check_perf ('dir-lookup-16', 'dir-lookup-64', 'dir-lookup-256');
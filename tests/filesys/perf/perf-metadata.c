@@ -0,0 +1,57 @@
+/* Measures the rate of file creation, lookup (open and close),
+   and removal in a single directory. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/perf/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+
+/* Stores the name of file I in NAME. */
+static void
+make_name (char name[READDIR_MAX_LEN + 1], int i)
+{
+  snprintf (name, READDIR_MAX_LEN + 1, "f%d", i);
+}
+
+void
+test_main (void)
+{
+  char name[READDIR_MAX_LEN + 1];
+  struct perf p;
+  int fd;
+  int i;
+
+  CHECK (mkdir ("meta"), "mkdir \"meta\"");
+  CHECK (chdir ("meta"), "chdir \"meta\"");
+
+  perf_begin (&p, "create");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  perf_end (&p, FILE_CNT, 0);
+
+  perf_begin (&p, "lookup");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  perf_end (&p, FILE_CNT, 0);
+
+  perf_begin (&p, "remove");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  perf_end (&p, FILE_CNT, 0);
+}
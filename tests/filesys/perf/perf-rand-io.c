@@ -0,0 +1,56 @@
+/* Measures the rate of random 512-byte reads and writes at
+   sector-aligned offsets within a 256 kB file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/perf/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define BLOCK_SIZE 512
+#define BLOCK_CNT (FILE_SIZE / BLOCK_SIZE)
+#define OP_CNT 1000
+
+static char buf[BLOCK_SIZE];
+
+/* Seeks FD to a random block. */
+static void
+seek_random (int fd)
+{
+  seek (fd, random_ulong () % BLOCK_CNT * BLOCK_SIZE);
+}
+
+void
+test_main (void)
+{
+  const char *file_name = "rand";
+  struct perf p;
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  perf_begin (&p, "rand-write");
+  for (i = 0; i < OP_CNT; i++)
+    {
+      seek_random (fd);
+      if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("write %d of %d in \"%s\" failed", i, OP_CNT, file_name);
+    }
+  perf_end (&p, OP_CNT, (long long) OP_CNT * BLOCK_SIZE);
+
+  perf_begin (&p, "rand-read");
+  for (i = 0; i < OP_CNT; i++)
+    {
+      seek_random (fd);
+      if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read %d of %d in \"%s\" failed", i, OP_CNT, file_name);
+    }
+  perf_end (&p, OP_CNT, (long long) OP_CNT * BLOCK_SIZE);
+
+  close (fd);
+}
@@ -0,0 +1,34 @@
+/* Measures sequential write throughput: writes a large file
+   from start to end in 4 kB chunks. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/perf/perf.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define CHUNK_SIZE 4096
+
+static char buf[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+  const char *file_name = "seq";
+  struct perf p;
+  size_t ofs;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  perf_begin (&p, "seq-write");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    if (write (fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+      fail ("write %d bytes at offset %zu in \"%s\" failed",
+            CHUNK_SIZE, ofs, file_name);
+  close (fd);
+  perf_end (&p, FILE_SIZE / CHUNK_SIZE, FILE_SIZE);
+}
@@ -0,0 +1,42 @@
+#include "tests/filesys/perf/perf.h"
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Starts measurement METRIC in P. */
+void
+perf_begin (struct perf *p, const char *metric)
+{
+  p->metric = metric;
+  if (!iostats (&p->start))
+    fail ("iostats failed");
+  if (!blockstats (NULL, &p->dev))
+    fail ("blockstats failed");
+}
+
+/* Ends the measurement in P, which performed OPS operations
+   transferring BYTES bytes of file data, and prints the result
+   as a line of the form
+     PERF metric=NAME ticks=T ops=N bytes=B reads=R writes=W
+          busy=C seq=S rand=X
+   where R and W are sectors read and written on the file system
+   disk in the meantime, C is the CPU cycles that the disk had
+   requests outstanding, and S and X count its sequential and
+   random requests. */
+void
+perf_end (struct perf *p, long long ops, long long bytes)
+{
+  struct iostats end;
+  struct blockstats dev;
+
+  if (!iostats (&end))
+    fail ("iostats failed");
+  if (!blockstats (NULL, &dev))
+    fail ("blockstats failed");
+  msg ("PERF metric=%s ticks=%lld ops=%lld bytes=%lld reads=%llu writes=%llu "
+       "busy=%llu seq=%llu rand=%llu",
+       p->metric, end.ticks - p->start.ticks, ops, bytes,
+       end.reads - p->start.reads, end.writes - p->start.writes,
+       dev.busy_tsc - p->dev.busy_tsc,
+       dev.sequential_cnt - p->dev.sequential_cnt,
+       dev.random_cnt - p->dev.random_cnt);
+}
@@ -0,0 +1,20 @@
+#ifndef TESTS_FILESYS_PERF_PERF_H
+#define TESTS_FILESYS_PERF_PERF_H
+
+#include <syscall.h>
+
+/* One timed measurement.  perf_begin() snapshots the timer and
+   the file system disk counters, perf_end() reports the
+   difference as a single machine-readable "PERF" line that
+   tests/filesys/perf/perf.pm picks up. */
+struct perf
+  {
+    const char *metric;         /* Name of the measurement. */
+    struct iostats start;       /* Counters at perf_begin(). */
+    struct blockstats dev;      /* File system device at perf_begin(). */
+  };
+
+void perf_begin (struct perf *, const char *metric);
+void perf_end (struct perf *, long long ops, long long bytes);
+
+#endif /* tests/filesys/perf/perf.h */
@@ -0,0 +1,72 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Timer interrupts per second, as in devices/timer.h.
+my ($TIMER_FREQ) = 100;
+
+# Checks that the test ran to completion and produced one
+# well-formed "PERF" line for each of @METRICS, then writes the
+# measurements to $test.perf, one per line, as space-separated
+# key=value pairs with the derived rates appended:
+#
+#   test=NAME metric=M ticks=T ops=N bytes=B reads=R writes=W
+#     busy=C seq=S rand=N ops_per_sec=X kb_per_sec=Y
+#
+# Rates are reported as "inf" when the measurement took less
+# than one timer tick.
+sub check_perf {
+    my (@metrics) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    my ($name) = $test =~ m%([^/]+)$%;
+    fail "First line of output is not `($name) begin' message.\n"
+      if !@output || $output[0] ne "($name) begin";
+    fail "Output missing `($name) end' message.\n"
+      if !grep ($_ eq "($name) end", @output);
+
+    my (%results);
+    foreach (@output) {
+	my ($fields) = /^\(\Q$name\E\) PERF (.*)$/ or next;
+	my (%r) = map (/^([a-z_]+)=(\S+)$/ ? ($1, $2)
+		       : fail ("Malformed PERF field `$_'.\n"),
+		       split (' ', $fields));
+	foreach my $key (qw (metric ticks ops bytes reads writes
+			     busy seq rand)) {
+	    fail "PERF line missing `$key': $_\n" if !defined $r{$key};
+	    fail "PERF field `$key' is not a number: $_\n"
+	      if $key ne 'metric' && $r{$key} !~ /^\d+$/;
+	}
+	fail "Duplicate PERF metric `$r{metric}'.\n"
+	  if defined $results{$r{metric}};
+	$results{$r{metric}} = \%r;
+    }
+
+    my ($perf_fn) = "$test.perf";
+    open (PERF, '>', $perf_fn) or die "$perf_fn: create: $!\n";
+    foreach my $metric (@metrics) {
+	my ($r) = $results{$metric};
+	fail "No PERF line for metric `$metric'.\n" if !defined $r;
+
+	my ($ops_rate, $kb_rate) = ('inf', 'inf');
+	if ($r->{ticks} > 0) {
+	    my ($secs) = $r->{ticks} / $TIMER_FREQ;
+	    $ops_rate = sprintf ("%.1f", $r->{ops} / $secs);
+	    $kb_rate = sprintf ("%.1f", $r->{bytes} / 1024 / $secs);
+	}
+	print PERF join (' ', "test=$name",
+			 map ("$_=$r->{$_}",
+			      qw (metric ticks ops bytes reads writes
+				  busy seq rand)),
+			 "ops_per_sec=$ops_rate", "kb_per_sec=$kb_rate"), "\n";
+    }
+    close (PERF);
+    pass;
+}
+
+1;
@@ -0,0 +1,48 @@
+/* Forks, and checks that the child gets 0 back from fork() and
+   the parent the child's pid, that writes by either process to a
+   data page and a stack page that they share copy-on-write stay
+   private to the writer, and that wait() returns the child's exit
+   status. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int data = 1;
+
+void
+test_main (void)
+{
+  int stack = 2;
+  pid_t pid;
+
+  /* Dirty both pages before forking. */
+  data = 10;
+  stack = 20;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      msg ("child: fork returned 0");
+      if (data != 10 || stack != 20)
+        fail ("child: data=%d stack=%d, not 10 and 20", data, stack);
+      data = 11;
+      stack = 21;
+      if (data != 11 || stack != 21)
+        fail ("child: data=%d stack=%d after writing 11 and 21",
+              data, stack);
+      msg ("child: writes stayed private");
+      exit (81);
+    }
+
+  /* Print nothing until the child is done, so that the output
+     does not depend on the order in which the two run. */
+  if (pid < 0)
+    fail ("fork returned %d", pid);
+  data = 12;
+  stack = 22;
+  CHECK (wait (pid) == 81, "wait for child (should return 81)");
+  if (data != 12 || stack != 22)
+    fail ("parent: data=%d stack=%d after writing 12 and 22", data, stack);
+  msg ("parent: writes stayed private");
+}
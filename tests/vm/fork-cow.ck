@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) child: fork returned 0
+(fork-cow) child: writes stayed private
+(fork-cow) wait for child (should return 81)
+(fork-cow) parent: writes stayed private
+(fork-cow) end
+EOF
+pass;
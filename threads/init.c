@@ -34,10 +34,21 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/md.h"
+#include "devices/pci.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-9p.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/hostfs.h"
 #include "filesys/directory.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -53,6 +64,12 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -md: Block devices to assemble into a RAID array. */
+static char *md_spec;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -78,6 +95,11 @@ int
 main (void)
 {
   char **argv;
+  uint64_t boot_cycles;
+
+  /* Time from the start of the loader, which recorded the
+     time-stamp counter for us, until now. */
+  boot_cycles = timer_tsc () - *(uint64_t *) ptov (LOADER_TSC);
 
   /* Clear BSS. */  
   bss_init ();
@@ -94,11 +116,16 @@ main (void)
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
+  printf ("Kernel loaded and started in %'"PRIu64" CPU cycles.\n",
+          boot_cycles);
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -123,12 +150,23 @@ main (void)
 
 #ifdef FILESYS
   /* Initialize file system. */
+  pci_init ();
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_kb > 0)
+    ramdisk_create ("rd0", ramdisk_kb);
+  if (md_spec != NULL)
+    md_setup (md_spec);
   locate_block_devices ();
   filesys_init (format_filesys);
+  virtio_9p_init ();
+  hostfs_init ();
 
   initial_thread->cur_directory = dir_open_root();
 
+#endif
+#ifdef VM
+  swap_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -251,6 +289,22 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-nodma"))
+        ide_use_dma = false;
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          if (value == NULL || atoi (value) <= 0)
+            PANIC ("-ramdisk needs a positive size in kB (use -h for help)");
+          ramdisk_kb = atoi (value);
+        }
+      else if (!strcmp (name, "-md"))
+        md_spec = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -263,6 +317,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        {
+          if (value == NULL || atoi (value) <= 0
+              || (size_t) atoi (value) > (size_t) PHYS_BASE / 1024 / 2)
+            PANIC ("-stack needs a size in kB, at most half of user "
+                   "space (use -h for help)");
+          page_stack_max = (size_t) atoi (value) * 1024;
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -319,6 +383,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"import", 2, fsutil_import},
+      {"export", 2, fsutil_export},
 #endif
       {NULL, 0, NULL},
     };
@@ -368,6 +434,8 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  import FILE        Copy FILE from host directory into file system.\n"
+          "  export FILE        Copy FILE from file system to host directory.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -377,6 +445,14 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -iosched=SCHED     Use I/O scheduler SCHED: noop, clook, or\n"
+          "                     deadline (the default).\n"
+          "  -nodma             Use PIO, not DMA, for IDE disks.\n"
+          "  -ramdisk=KB        Make KB kB RAM disk rd0, for use as e.g.\n"
+          "                     -filesys=rd0, -scratch=rd0, or -swap=rd0.\n"
+          "  -md=N:BDEV,BDEV... Make BDEVs into RAID-N array md0, where N\n"
+          "                     is 0 (striped) or 1 (mirrored).  Use with\n"
+          "                     e.g. -filesys=md0.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -385,6 +461,9 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack=KB          Let user stacks grow to KB kB (default 8192).\n"
 #endif
           );
   shutdown_power_off ();
@@ -17,6 +17,7 @@
 #define LOADER_PARTS (LOADER_SIG - LOADER_PARTS_LEN)     /* Partition table. */
 #define LOADER_ARGS (LOADER_PARTS - LOADER_ARGS_LEN)   /* Command-line args. */
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
+#define LOADER_TSC LOADER_BASE  /* TSC when loader started (64 bits). */
 
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
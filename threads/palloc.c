@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,7 +24,17 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Zeroing a page for PAL_ZERO costs a few microseconds on the
+   allocating thread, which is often handling a page fault or
+   creating a process.  So the idle thread keeps a few free pages
+   of each pool zeroed ahead of time, by calling palloc_prezero()
+   whenever there is nothing else to run, and single-page PAL_ZERO
+   allocations take those first. */
+
+/* Most pre-zeroed pages kept per pool. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
@@ -31,6 +42,12 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Pages zeroed ahead of time, which are marked used in
+       USED_MAP.  Protected by disabling interrupts, so that the
+       idle thread can add to them without blocking. */
+    void *zeroed[ZEROED_MAX];
+    size_t zeroed_cnt;
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +56,8 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *take_zeroed (struct pool *);
+static bool prezero (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,12 +96,22 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  /* Use a page zeroed ahead of time, if it will do. */
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
+  else if (page_cnt == 1 && (pages = take_zeroed (pool)) != NULL)
+    return pages;
   else
     pages = NULL;
 
@@ -133,8 +162,14 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   page_idx = pg_no (pages) - pg_no (pool->base);
 
+  /* Fill freed memory with a pattern, so that use after free is
+     easier to spot.  Nothing defines NDEBUG, so this would cost a
+     memset on every free.  Single pages are freed all the time by
+     page faults, eviction, and process exit, so skip the fill for
+     those, to keep them off the critical path. */
 #ifndef NDEBUG
-  memset (pages, 0xcc, PGSIZE * page_cnt);
+  if (page_cnt > 1)
+    memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
@@ -148,6 +183,68 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page ahead of time, for a later PAL_ZERO
+   allocation.  Returns true if it did, false if there was
+   nothing to do.  Called by the idle thread, so it never
+   blocks. */
+bool
+palloc_prezero (void)
+{
+  return prezero (&user_pool) || prezero (&kernel_pool);
+}
+
+/* Zeroes a free page of POOL ahead of time, if POOL has room for
+   more pre-zeroed pages.  Returns true if successful, false
+   otherwise. */
+static bool
+prezero (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx;
+  void *page;
+
+  /* Only the idle thread adds pages, so if there is room now,
+     there still will be after zeroing. */
+  if (pool->zeroed_cnt >= ZEROED_MAX)
+    return false;
+
+  /* Hold the pool lock with interrupts off, so that no thread
+     that wants it waits for the idle thread to run again. */
+  page_idx = BITMAP_ERROR;
+  old_level = intr_disable ();
+  if (lock_try_acquire (&pool->lock))
+    {
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+      lock_release (&pool->lock);
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  pool->zeroed[pool->zeroed_cnt++] = page;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Returns a page of POOL that was zeroed ahead of time, or a
+   null pointer if there is none. */
+static void *
+take_zeroed (struct pool *pool)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt > 0)
+    page = pool->zeroed[--pool->zeroed_cnt];
+  intr_set_level (old_level);
+  return page;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -167,6 +264,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->zeroed_cnt = 0;
 }
 
 /* Returns true if PAGE was allocated from POOL,
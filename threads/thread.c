@@ -405,6 +405,14 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* There is nothing else to run, so zero a free page for
+         later.  That takes a while, so look for other work again
+         before halting. */
+      intr_enable ();
+      if (palloc_prezero ())
+        continue;
+      intr_disable ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -476,6 +484,9 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init(&t->reaper, 0);
   sema_init(&t->started, 0);
   list_init(&t->children);
+#ifdef VM
+  list_init(&t->mappings);
+#endif
 
   old_level = intr_disable();
   list_push_back (&all_list, &t->allelem);
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,9 +152,28 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page, if the process has one there.  This also
+     covers the kernel touching a user buffer during a system
+     call. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && page_load (fault_addr, write))
+    return;
+
+  /* Grow the stack, if this looks like a push below its bottom.
+     In a system call, F->esp is the kernel's stack pointer, so use
+     the one the process made the call with. */
+  if (not_present
+      && page_grow_stack (fault_addr,
+                          user ? f->esp : thread_current ()->user_esp))
+    return;
+
+  /* Give a page shared copy-on-write since fork() a copy of its
+     own on the first write. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_unshare (fault_addr))
+    return;
+#endif
 
 //if the page fault occurs in a user context, set the exit_status of the thread to -1 and kill the thread
   if(user){
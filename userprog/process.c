@@ -11,12 +11,17 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 
 static thread_func start_process NO_RETURN;
@@ -108,6 +113,122 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* What process_fork() passes to the child. */
+struct fork_info
+  {
+    struct thread *parent;      /* Process being forked. */
+    struct intr_frame if_;      /* Parent's user registers. */
+  };
+
+static thread_func start_fork NO_RETURN;
+
+/* Starts a new process that is a copy of the current one, which
+   made system call F, and returns the new process's thread id,
+   or TID_ERROR if it cannot be created.  The new process returns
+   0 from the system call.
+
+   The copy shares all of our pages copy-on-write, so it costs
+   page table work instead of copying memory. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct fork_info info;
+  struct list_elem *e;
+  tid_t tid;
+
+  info.parent = t;
+  info.if_ = *f;
+  tid = thread_create (t->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* Wait for the child to copy us, so that INFO stays valid and
+     our address space holds still until it is done. */
+  for (e = list_begin (&t->children); e != list_end (&t->children);
+       e = list_next (e))
+    {
+      struct thread *child = list_entry (e, struct thread, child_elem);
+      if (child->tid == tid)
+        {
+          sema_down (&child->started);
+          if (child->started_error)
+            tid = TID_ERROR;
+          break;
+        }
+    }
+  return tid;
+}
+
+/* A thread function that makes the current thread a copy of the
+   process described by INFO_ and starts it running. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+  int fd;
+
+  t->cur_directory = dir_reopen (parent->cur_directory);
+
+  /* Duplicate the executable and the open files, each with its
+     own file position. */
+  t->exec_file = file_reopen (parent->exec_file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+  for (fd = 0; fd < MAX_FILES; fd++)
+    {
+      struct file *file = parent->open_files[fd];
+
+      if (file == NULL)
+        continue;
+      if (file->inode->data.is_dir)
+        t->open_files[fd] = (struct file *) dir_reopen ((struct dir *) file);
+      else
+        {
+          t->open_files[fd] = file_reopen (file);
+          if (t->open_files[fd] != NULL)
+            file_seek (t->open_files[fd], file_tell (file));
+        }
+      if (t->open_files[fd] == NULL)
+        goto done;
+    }
+
+  /* Share the address space. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  if (!page_table_create ())
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+  process_activate ();
+  success = page_table_fork (parent, t->exec_file);
+
+ done:
+  t->started_error = !success;
+  sema_up (&t->started);
+  if (!success)
+    {
+      t->exit_status = -1;
+      sema_up (&t->reaper);
+      thread_exit ();
+    }
+
+  /* The child returns 0 from fork(). */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -194,6 +315,10 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -308,6 +433,14 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_create ())
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
   /*parses the command line*/
@@ -481,7 +614,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -540,6 +675,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here, and page_fault() reads each one
+   in when the process first touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -550,6 +689,23 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -585,6 +741,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -592,9 +749,17 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
   bool success = false;
 
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  success = page_add_zero (upage, true) && page_load (upage, true);
+  if (success)
+    *esp = PHYS_BASE;
+#else
+  uint8_t *kpage;
+
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
@@ -604,9 +769,11 @@ setup_stack (void **esp)
       else
         palloc_free_page (kpage);
     }
+#endif
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -626,3 +793,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,15 +1,23 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "filesys/inode.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/directory.h"
 #include "lib/user/syscall.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
@@ -26,7 +34,14 @@ syscall_init (void)
 int addr_is_good (void *a) 
 {
 	return a!=NULL && is_user_vaddr(a) && 
-  pagedir_get_page (thread_current()->pagedir, a);
+  (pagedir_get_page (thread_current()->pagedir, a)
+#ifdef VM
+   //not loaded yet, so load it now
+   || page_load (a, false)
+   //or it might be the stack growing into a buffer
+   || page_grow_stack (a, thread_current()->user_esp)
+#endif
+  );
 }
 
 /*passes pointer to add_is_good to make sure that the address is valid, 
@@ -39,10 +54,87 @@ void check_arg (void *a)
   	}
 }
 
-/*translates the user address */
+/*checks that all SIZE bytes at BUFFER are in pages the process may
+  write, and exits the thread if not.  the kernel writes to them
+  through the user address, and a page fault it cannot resolve there,
+  like a write to the code segment, would panic the kernel instead of
+  killing the process*/
+void check_writable (void *buffer, unsigned size)
+{
+  struct thread *t = thread_current();
+  uint8_t *end = (uint8_t *) buffer + size;
+  uint8_t *a;
+
+  if (size == 0)
+    return;
+  if (end < (uint8_t *) buffer) {
+    t->exit_status = -1;
+    thread_exit();
+  }
+  for (a = buffer; a < end; a = (uint8_t *) pg_round_down(a) + PGSIZE) {
+#ifdef VM
+    //the stack may have to grow to reach the rest of the buffer
+    struct page *p = page_lookup(a);
+    if (p == NULL && is_user_vaddr(a) && page_grow_stack(a, t->user_esp))
+      p = page_lookup(a);
+    if (p == NULL || !p->writable) {
+      t->exit_status = -1;
+      thread_exit();
+    }
+#else
+    check_arg(a);
+#endif
+  }
+}
+
+/*translates the user address
+  with VM this also pins the page, so it has to be released with page_unpin */
 void *uservtop (void *uaddr, struct thread *t) 
 {
+#ifdef VM
+  return page_pin(uaddr);
+#else
   return pagedir_get_page(thread_current()->pagedir, uaddr);
+#endif
+}
+
+/*writes SIZE bytes of the user BUFFER to FD (the console if FD is 1)
+  and returns the number of bytes written.  user pages that are next to
+  each other need not be next to each other in kernel memory, so this
+  goes through the buffer one page at a time*/
+static int
+write_user (struct thread *t, int fd, const char *buffer, unsigned size)
+{
+  int written = 0;
+
+  while (size > 0) {
+    unsigned chunk = PGSIZE - pg_ofs(buffer);
+    void *kaddr = uservtop((void *) buffer, t);
+    int n;
+
+    if (chunk > size)
+      chunk = size;
+    if (kaddr == NULL) {
+      t->exit_status = -1;
+      thread_exit();
+    }
+    if (fd == 1) {
+      putbuf(kaddr, chunk);
+      n = chunk;
+    }
+    else
+      n = file_write(t->open_files[fd], kaddr, chunk);
+#ifdef VM
+    page_unpin(buffer);
+#endif
+
+    written += n;
+    if ((unsigned) n < chunk)
+      break;
+    buffer += chunk;
+    size -= chunk;
+  }
+  return written;
 }
 
 static void
@@ -50,6 +142,10 @@ syscall_handler (struct intr_frame *f)
 {
   struct thread *t = thread_current();
   void *esp = f->esp;
+#ifdef VM
+  //page faults in the kernel need the user's esp to grow the stack
+  t->user_esp = esp;
+#endif
   check_arg(esp);
   int32_t call_num = POP_ESP(int32_t);
 
@@ -211,10 +307,11 @@ syscall_handler (struct intr_frame *f)
       check_arg(buffer);
       check_arg(esp);
       unsigned size = POP_ESP(unsigned);
+      check_writable(buffer, size);
 
       if(0 == fd){
-        int read = 0;
-        for(;read<=size; read++){
+        unsigned read = 0;
+        for(;read<size; read++){
           *buffer = input_getc();
           buffer++;
         }
@@ -247,17 +344,11 @@ syscall_handler (struct intr_frame *f)
     	check_arg(esp);
     	unsigned size = POP_ESP(unsigned);
 
-      if(fd == 1){
-        putbuf(uservtop(buffer, t), size);
-        f->eax = size;
+      if(fd != 1 && t->open_files[fd] == NULL){
+        f->eax = 0;
+        return;
       }
-      else{
-        if(t->open_files[fd] == NULL){
-          f->eax = 0;
-          return;
-        }
-                f->eax = file_write(t->open_files[fd], uservtop(buffer, t), size);
-              }
+      f->eax = write_user(t, fd, buffer, size);
       return;
 
     }
@@ -389,6 +480,79 @@ syscall_handler (struct intr_frame *f)
 
     }
 
+    case SYS_IOSTATS: {
+      check_arg(esp);
+      struct iostats *stats = POP_ESP(void*);
+      /*the whole struct has to be writable*/
+      check_arg(stats);
+      check_writable(stats, sizeof *stats);
+      stats->ticks = timer_ticks ();
+      stats->reads = block_read_cnt (fs_device);
+      stats->writes = block_write_cnt (fs_device);
+      f->eax = true;
+      return;
+    }
+
+    case SYS_BLOCKSTATS: {
+      check_arg(esp);
+      const char *name = POP_ESP(const char *);
+      check_arg(esp);
+      struct blockstats *stats = POP_ESP(void*);
+      check_arg(stats);
+      check_writable(stats, sizeof *stats);
+      /*a null name means the file system device*/
+      struct block *block = fs_device;
+      if (name != NULL) {
+        check_arg((void *) name);
+        block = block_get_by_name (name);
+      }
+      if (block == NULL) {
+        f->eax = false;
+        return;
+      }
+      struct block_stats bs;
+      block_get_stats (block, &bs);
+      stats->read_bytes = bs.read_bytes;
+      stats->write_bytes = bs.write_bytes;
+      stats->sequential_cnt = bs.sequential_cnt;
+      stats->random_cnt = bs.random_cnt;
+      stats->complete_cnt = bs.complete_cnt;
+      stats->busy_tsc = bs.busy_tsc;
+      memcpy (stats->latency_ticks, bs.latency_ticks, sizeof bs.latency_ticks);
+      memcpy (stats->latency_tsc, bs.latency_tsc, sizeof bs.latency_tsc);
+      f->eax = true;
+      return;
+    }
+
+#ifdef VM
+    case SYS_MMAP: {
+      check_arg(esp);
+      int fd = POP_ESP(int);
+      check_arg(esp);
+      void *addr = POP_ESP(void*);
+      /*console and directories can't be mapped*/
+      if(fd>=MAX_FILES || fd<2 || t->open_files[fd] == NULL
+         || t->open_files[fd]->inode->data.is_dir){
+        f->eax = MAP_FAILED;
+        return;
+      }
+      f->eax = mmap_map(t->open_files[fd], addr);
+      return;
+    }
+
+    case SYS_MUNMAP: {
+      check_arg(esp);
+      mapid_t mapping = POP_ESP(mapid_t);
+      mmap_unmap(mapping);
+      return;
+    }
+
+    case SYS_FORK: {
+      f->eax = process_fork(f);
+      return;
+    }
+#endif
+
     default:	{
     	printf ("unknown system call (%d)!\n", call_num);
       /*unknown system call is an error*/
@@ -0,0 +1,527 @@
+/* pintos-mkfs: builds a formatted, populated Pintos file system
+   partition on the host, without booting the kernel.
+
+   The image uses the same on-disk structures as the kernel (see
+   filesys/inode.h, filesys/directory.h, filesys/free-map.h) and
+   follows the same allocation group policy, so the kernel reads
+   it just like one written by `pintos -f' followed by `extract',
+   with the same files, directories, and free map format.  The
+   exact sectors differ, though: this tool allocates all of a
+   file's indirection blocks before its data sectors, where the
+   kernel allocates each indirection block just before the data
+   sectors it points to.  Pass the result to `pintos --filesys=IMAGE'
+   or `pintos-mkdisk --filesys=IMAGE'. */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The Pintos headers define their own 32-bit off_t, which clashes
+   with the host's. */
+#define off_t pintos_off_t
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#undef off_t
+
+static const char *program_name;
+
+static uint8_t *image;                  /* Image contents. */
+static block_sector_t sector_cnt;       /* Image size in sectors. */
+static uint32_t *free_map;              /* One bit per sector, as in bitmap.c. */
+static size_t free_map_bytes;           /* Size of FREE_MAP in bytes. */
+
+static void usage (int exit_code) __attribute__ ((noreturn));
+static void fail (const char *msg, ...)
+     __attribute__ ((noreturn))
+     __attribute__ ((format (printf, 1, 2)));
+
+/* Prints MSG, formatting as with printf(), plus an error message
+   based on errno if it is nonzero, and exits. */
+static void
+fail (const char *msg, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, msg);
+  vfprintf (stderr, msg, args);
+  va_end (args);
+
+  if (errno != 0)
+    fprintf (stderr, ": %s", strerror (errno));
+  putc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+/* Returns a pointer to the contents of SECTOR in the image. */
+static void *
+sector_ptr (block_sector_t sector)
+{
+  if (sector >= sector_cnt)
+    fail ("internal error: sector %"PRDSNu" out of range", sector);
+  return image + (size_t) sector * BLOCK_SECTOR_SIZE;
+}
+
+/* Free map. */
+
+static bool
+free_map_test (size_t sector)
+{
+  return (free_map[sector / 32] >> (sector % 32)) & 1;
+}
+
+static void
+free_map_mark (size_t sector)
+{
+  free_map[sector / 32] |= (uint32_t) 1 << (sector % 32);
+}
+
+/* Allocates the first free sector in START...END-1 into
+   *SECTORP.  Returns true if successful. */
+static bool
+allocate_range (size_t start, size_t end, block_sector_t *sectorp)
+{
+  size_t sector;
+
+  if (end > sector_cnt)
+    end = sector_cnt;
+  for (sector = start; sector < end; sector++)
+    if (!free_map_test (sector))
+      {
+        free_map_mark (sector);
+        *sectorp = sector;
+        return true;
+      }
+  return false;
+}
+
+static size_t
+group_end (size_t group)
+{
+  size_t end = (group + 1) * GROUP_SECTORS;
+  return end < sector_cnt ? end : sector_cnt;
+}
+
+/* Allocates a data sector as close as possible after NEAR, as
+   free_map_allocate_near() does. */
+static block_sector_t
+allocate_near (block_sector_t near)
+{
+  size_t group = near / GROUP_SECTORS;
+  size_t data_start = group * GROUP_SECTORS + GROUP_INODE_SECTORS;
+  block_sector_t sector;
+
+  if (allocate_range (near > data_start ? near : data_start,
+                      group_end (group), &sector)
+      || allocate_range (data_start, group_end (group), &sector)
+      || allocate_range (near, sector_cnt, &sector)
+      || allocate_range (0, sector_cnt, &sector))
+    return sector;
+  errno = 0;
+  fail ("file system image full");
+}
+
+/* Allocates an inode sector for a file in the directory whose
+   inode is PARENT, as free_map_allocate_inode() does. */
+static block_sector_t
+allocate_inode (block_sector_t parent)
+{
+  size_t group_cnt = (sector_cnt + GROUP_SECTORS - 1) / GROUP_SECTORS;
+  block_sector_t sector;
+  size_t i;
+
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t start = (parent / GROUP_SECTORS + i) % group_cnt * GROUP_SECTORS;
+      if (allocate_range (start, start + GROUP_INODE_SECTORS, &sector))
+        return sector;
+    }
+  return allocate_near (parent);
+}
+
+/* Allocates an inode sector for a new directory in the group
+   with the most free sectors, as free_map_allocate_dir() does. */
+static block_sector_t
+allocate_dir (void)
+{
+  size_t group_cnt = (sector_cnt + GROUP_SECTORS - 1) / GROUP_SECTORS;
+  size_t best = 0, best_free = 0;
+  size_t group, sector;
+
+  for (group = 0; group < group_cnt; group++)
+    {
+      size_t free_cnt = 0;
+      for (sector = group * GROUP_SECTORS; sector < group_end (group);
+           sector++)
+        free_cnt += !free_map_test (sector);
+      if (free_cnt > best_free)
+        {
+          best = group;
+          best_free = free_cnt;
+        }
+    }
+  return allocate_inode (best * GROUP_SECTORS);
+}
+
+/* Inodes. */
+
+/* Appends one data sector to the indirection block at TABLE and
+   returns it.  The image starts out zeroed, so the new sector
+   already reads as zeros. */
+static block_sector_t
+add_sector (block_sector_t table)
+{
+  struct indirection_block *ind = sector_ptr (table);
+  block_sector_t near = ind->length > 0 ? ind->sectors[ind->length - 1] : table;
+
+  if (ind->length >= TABLE_SIZE)
+    fail ("internal error: indirection block overflow");
+  ind->sectors[ind->length] = allocate_near (near);
+  return ind->sectors[ind->length++];
+}
+
+/* Writes an inode with LENGTH bytes of zeroed data to SECTOR,
+   with the same structure as inode_create() gives it: every full
+   indirection block, followed by one (possibly empty) partial
+   block.  Unlike inode_create(), allocates all the indirection
+   blocks first and then the data sectors. */
+static void
+create_inode (block_sector_t sector, off_t length, bool is_dir)
+{
+  struct inode_disk *disk_inode = sector_ptr (sector);
+  size_t sectors = (length + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+  size_t i;
+
+  disk_inode->length = length;
+  disk_inode->magic = INODE_MAGIC;
+  disk_inode->is_dir = is_dir;
+  if (sectors / TABLE_SIZE >= NUM_TABLES)
+    {
+      errno = 0;
+      fail ("file too large (%jd bytes)", (intmax_t) length);
+    }
+  for (i = 0; i <= sectors / TABLE_SIZE; i++)
+    disk_inode->indirection[i] = allocate_near (sector);
+  for (i = 0; i < sectors; i++)
+    add_sector (disk_inode->indirection[i / TABLE_SIZE]);
+}
+
+/* Returns the sector holding byte POS of the inode in SECTOR. */
+static block_sector_t
+byte_to_sector (block_sector_t sector, off_t pos)
+{
+  struct inode_disk *disk_inode = sector_ptr (sector);
+  struct indirection_block *ind;
+
+  ind = sector_ptr (disk_inode->indirection[pos / (TABLE_SIZE
+                                                   * BLOCK_SECTOR_SIZE)]);
+  return ind->sectors[pos / BLOCK_SECTOR_SIZE % TABLE_SIZE];
+}
+
+/* Extends the inode in SECTOR by one zeroed sector, keeping a
+   spare empty indirection block past the last full one as
+   inode_create() does, and returns the new sector. */
+static block_sector_t
+extend_inode (block_sector_t sector)
+{
+  struct inode_disk *disk_inode = sector_ptr (sector);
+  size_t sectors = (disk_inode->length + BLOCK_SECTOR_SIZE - 1)
+                   / BLOCK_SECTOR_SIZE;
+  block_sector_t new_sector;
+
+  disk_inode->length = (sectors + 1) * BLOCK_SECTOR_SIZE;
+  new_sector = add_sector (disk_inode->indirection[sectors / TABLE_SIZE]);
+  if ((sectors + 1) % TABLE_SIZE == 0)
+    disk_inode->indirection[(sectors + 1) / TABLE_SIZE] = allocate_near (sector);
+  return new_sector;
+}
+
+/* Directories. */
+
+/* Creates a directory inode in SECTOR with room for ENTRY_CNT
+   entries, as dir_create() does. */
+static void
+create_dir (block_sector_t sector, size_t entry_cnt)
+{
+  size_t bytes = entry_cnt * DIR_REC_LEN (NAME_MAX);
+  create_inode (sector, (bytes + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE
+                        * BLOCK_SECTOR_SIZE, true);
+}
+
+/* Returns the length of the record at byte OFS of directory
+   sector BUF, as in directory.c. */
+static size_t
+rec_len (const uint8_t *buf, size_t ofs)
+{
+  const struct dir_entry *e = (const struct dir_entry *) (buf + ofs);
+  return e->rec_len != 0 ? e->rec_len : BLOCK_SECTOR_SIZE - ofs;
+}
+
+/* Returns the inode sector of entry NAME in directory DIR, or 0
+   if there is none. */
+static block_sector_t
+dir_find (block_sector_t dir, const char *name)
+{
+  struct inode_disk *disk_inode = sector_ptr (dir);
+  size_t name_len = strlen (name);
+  off_t base;
+
+  for (base = 0; base < disk_inode->length; base += BLOCK_SECTOR_SIZE)
+    {
+      const uint8_t *buf = sector_ptr (byte_to_sector (dir, base));
+      size_t ofs;
+
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; ofs += rec_len (buf, ofs))
+        {
+          const struct dir_entry *e = (const struct dir_entry *) (buf + ofs);
+          if (e->inode_sector != 0 && e->name_len == name_len
+              && !memcmp (e->name, name, name_len))
+            return e->inode_sector;
+        }
+    }
+  return 0;
+}
+
+/* Adds NAME, referring to INODE_SECTOR, to directory DIR, as
+   dir_add() does, and records DIR as the entry's parent. */
+static void
+add_entry (block_sector_t dir, const char *name, block_sector_t inode_sector)
+{
+  struct inode_disk *disk_inode = sector_ptr (dir);
+  size_t name_len = strlen (name);
+  size_t need = DIR_REC_LEN (name_len);
+  struct dir_entry *new;
+  uint8_t *buf;
+  off_t base;
+
+  if (name_len == 0 || name_len > NAME_MAX)
+    {
+      errno = 0;
+      fail ("%s: invalid file name", name);
+    }
+
+  for (base = 0; base < disk_inode->length; base += BLOCK_SECTOR_SIZE)
+    {
+      size_t ofs;
+
+      buf = sector_ptr (byte_to_sector (dir, base));
+      for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; ofs += rec_len (buf, ofs))
+        {
+          struct dir_entry *e = (struct dir_entry *) (buf + ofs);
+          size_t len = rec_len (buf, ofs);
+          size_t used = e->inode_sector != 0 ? DIR_REC_LEN (e->name_len) : 0;
+
+          if (len - used >= need)
+            {
+              new = (struct dir_entry *) (buf + ofs + used);
+              if (used != 0)
+                e->rec_len = used;
+              new->rec_len = len - used;
+              goto found;
+            }
+        }
+    }
+
+  buf = sector_ptr (extend_inode (dir));
+  new = (struct dir_entry *) buf;
+  new->rec_len = BLOCK_SECTOR_SIZE;
+
+ found:
+  new->inode_sector = inode_sector;
+  new->name_len = name_len;
+  memcpy (new->name, name, name_len);
+  ((struct inode_disk *) sector_ptr (inode_sector))->parent_directory = dir;
+}
+
+/* Returns the directory named by the first LENGTH bytes of PATH,
+   creating it and any missing parents. */
+static block_sector_t
+make_dirs (const char *path, size_t length)
+{
+  block_sector_t dir = ROOT_DIR_SECTOR;
+  char name[NAME_MAX + 1];
+
+  while (length > 0)
+    {
+      const char *slash = memchr (path, '/', length);
+      size_t name_len = slash != NULL ? (size_t) (slash - path) : length;
+      block_sector_t child;
+
+      if (name_len > NAME_MAX)
+        {
+          errno = 0;
+          fail ("%.*s: name too long", (int) name_len, path);
+        }
+      memcpy (name, path, name_len);
+      name[name_len] = '\0';
+
+      if (name_len > 0)
+        {
+          child = dir_find (dir, name);
+          if (child == 0)
+            {
+              child = allocate_dir ();
+              create_dir (child, 1);
+              add_entry (dir, name, child);
+            }
+          else if (!((struct inode_disk *) sector_ptr (child))->is_dir)
+            {
+              errno = 0;
+              fail ("%s: not a directory", name);
+            }
+          dir = child;
+        }
+
+      if (slash == NULL)
+        break;
+      length -= name_len + 1;
+      path = slash + 1;
+    }
+  return dir;
+}
+
+/* Copies host file HOST_NAME into the image as GUEST_NAME. */
+static void
+put_file (const char *host_name, const char *guest_name)
+{
+  const char *base = strrchr (guest_name, '/');
+  block_sector_t dir, inode_sector;
+  struct stat st;
+  FILE *file;
+  off_t ofs;
+
+  base = base != NULL ? base + 1 : guest_name;
+  dir = make_dirs (guest_name, base - guest_name);
+  if (dir_find (dir, base) != 0)
+    {
+      errno = 0;
+      fail ("%s: file already exists", guest_name);
+    }
+
+  file = fopen (host_name, "rb");
+  if (file == NULL || fstat (fileno (file), &st) < 0)
+    fail ("%s: open", host_name);
+
+  inode_sector = allocate_inode (dir);
+  create_inode (inode_sector, st.st_size, false);
+  for (ofs = 0; ofs < st.st_size; ofs += BLOCK_SECTOR_SIZE)
+    {
+      size_t chunk = st.st_size - ofs < BLOCK_SECTOR_SIZE
+                     ? (size_t) (st.st_size - ofs) : BLOCK_SECTOR_SIZE;
+      if (fread (sector_ptr (byte_to_sector (inode_sector, ofs)), 1, chunk,
+                 file) != chunk)
+        fail ("%s: read", host_name);
+    }
+  fclose (file);
+  add_entry (dir, base, inode_sector);
+}
+
+/* Formats the image, as do_format() does. */
+static void
+format (void)
+{
+  free_map_mark (FREE_MAP_SECTOR);
+  free_map_mark (ROOT_DIR_SECTOR);
+  create_inode (FREE_MAP_SECTOR, free_map_bytes, false);
+  create_dir (ROOT_DIR_SECTOR, 16);
+}
+
+/* Copies the free map into the free map file, which must come
+   last since it records every allocation. */
+static void
+write_free_map (void)
+{
+  size_t ofs;
+
+  for (ofs = 0; ofs < free_map_bytes; ofs += BLOCK_SECTOR_SIZE)
+    {
+      size_t chunk = free_map_bytes - ofs < BLOCK_SECTOR_SIZE
+                     ? free_map_bytes - ofs : BLOCK_SECTOR_SIZE;
+      memcpy (sector_ptr (byte_to_sector (FREE_MAP_SECTOR, ofs)),
+              (uint8_t *) free_map + ofs, chunk);
+    }
+}
+
+static void
+usage (int exit_code)
+{
+  printf ("pintos-mkfs, builds a populated Pintos file system partition\n"
+          "Usage: %s [-s SIZE] IMAGE [HOSTFILE[:GUESTNAME]...]\n"
+          "  -s SIZE    Make the partition SIZE MB (default: 2)\n"
+          "  -h         Display this help message\n"
+          "Each HOSTFILE is copied into the file system as GUESTNAME,\n"
+          "by default under the same name.  Directories in GUESTNAME\n"
+          "are created as needed.  Use the result with\n"
+          "`pintos --filesys=IMAGE' or `pintos-mkdisk --filesys=IMAGE'.\n",
+          program_name);
+  exit (exit_code);
+}
+
+int
+main (int argc, char *argv[])
+{
+  double size_mb = 2.0;
+  const char *image_name;
+  FILE *out;
+  int opt;
+
+  program_name = argv[0];
+  while ((opt = getopt (argc, argv, "s:h")) != -1)
+    switch (opt)
+      {
+      case 's':
+        size_mb = strtod (optarg, NULL);
+        break;
+      case 'h':
+        usage (EXIT_SUCCESS);
+      default:
+        usage (EXIT_FAILURE);
+      }
+  if (optind >= argc)
+    usage (EXIT_FAILURE);
+  image_name = argv[optind++];
+
+  sector_cnt = size_mb * 1024 * 1024 / BLOCK_SECTOR_SIZE;
+  if (sector_cnt < GROUP_INODE_SECTORS)
+    {
+      errno = 0;
+      fail ("%s: image too small", image_name);
+    }
+  free_map_bytes = (sector_cnt + 31) / 32 * sizeof *free_map;
+  image = calloc (sector_cnt, BLOCK_SECTOR_SIZE);
+  free_map = calloc (1, free_map_bytes);
+  if (image == NULL || free_map == NULL)
+    fail ("out of memory");
+
+  format ();
+  for (; optind < argc; optind++)
+    {
+      char *host_name = argv[optind];
+      char *guest_name = strchr (host_name, ':');
+      if (guest_name != NULL)
+        *guest_name++ = '\0';
+      else
+        guest_name = host_name;
+      while (*guest_name == '/')
+        guest_name++;
+      put_file (host_name, guest_name);
+    }
+  write_free_map ();
+
+  out = fopen (image_name, "wb");
+  if (out == NULL)
+    fail ("%s: create", image_name);
+  if (fwrite (image, BLOCK_SECTOR_SIZE, sector_cnt, out) != sector_cnt
+      || fclose (out) != 0)
+    fail ("%s: write", image_name);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,512 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* The code in this file keeps a table of every frame in the user
+   pool that holds a user page.  When the user pool runs out,
+   frame_alloc() takes a frame away from some page, chosen by the
+   clock algorithm: the clock hand sweeps the table, giving each
+   page whose accessed bit is set a second chance and clearing
+   the bit, and takes the first frame that has not been accessed
+   since the last sweep, handing its pages to page_out().
+
+   Dirty pages go to swap.  Writing them one at a time would cost
+   a disk command, and usually a seek, per page, so the sweep
+   instead goes on collecting dirty pages, up to SWAP_CLUSTER of
+   them, and writes them together to a run of adjacent slots.
+   The frames beyond the one that was asked for go back to the
+   user pool, so the next several allocations need not evict.
+
+   A frame is pinned while its page is being read in, so that it
+   cannot be taken away half-full, and while the kernel uses it
+   through its kernel address.
+
+   Read-only file pages, such as executable text, are shared:
+   every process that maps the same page of the same file gets
+   the same frame, which the shared frame table finds by inode
+   and offset.  The frame goes away when the last of its pages
+   does, or all at once when it is evicted.
+
+   fork() also makes the child's pages share the parent's frames,
+   mapped read-only in both processes.  The first write to such a
+   page faults, and frame_unshare() gives the page a copy of its
+   own.  All-zero pages that are only read share the zero frame
+   in the same way, so a program with a big BSS uses memory only
+   for the parts it writes. */
+
+/* All frames holding user pages, in clock order. */
+static struct list frames;
+
+/* Clock hand: the next frame to consider, or list_end (&frames). */
+static struct list_elem *hand;
+
+/* Shared frames, keyed by inode and offset. */
+static struct hash shared_frames;
+
+/* A page of zeros, shared read-only by every page that is all
+   zeros and has not been written yet, such as untouched BSS and
+   stack.  It is not in the frame table, so it is never evicted
+   or released. */
+static struct frame zero_frame;
+
+/* Protects FRAMES, HAND, SHARED_FRAMES, the members of each
+   frame, and the `frame' and `frame_elem' members of each page
+   that has a frame. */
+static struct lock frame_lock;
+
+static struct frame *evict (void);
+static void release (struct frame *);
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frames);
+  hand = list_end (&frames);
+  if (!hash_init (&shared_frames, frame_hash, frame_less, NULL))
+    PANIC ("frame: shared frame table creation failed");
+  lock_init (&frame_lock);
+
+  zero_frame.kpage = palloc_get_page (PAL_ZERO);
+  if (zero_frame.kpage == NULL)
+    PANIC ("frame: zero page allocation failed");
+  list_init (&zero_frame.pages);
+  zero_frame.pin_cnt = 0;
+  zero_frame.dirty = false;
+  zero_frame.inode = NULL;
+}
+
+/* Returns a pinned frame for page P of the current process, or
+   for no page yet if P is null, from the user pool, filled with
+   zeros if ZERO is true.  If the pool is empty, evicts some other
+   page if EVICT_OK is true, and otherwise returns a null pointer.
+   Also returns a null pointer if no frame can be had. */
+static struct frame *
+alloc (struct page *p, bool evict_ok, bool zero)
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f != NULL)
+        {
+          f->kpage = kpage;
+          list_init (&f->pages);
+          list_insert (hand, &f->elem);
+        }
+      else
+        palloc_free_page (kpage);
+    }
+  else if (evict_ok)
+    {
+      f = evict ();
+      if (f != NULL && zero)
+        memset (f->kpage, 0, PGSIZE);
+    }
+
+  if (f != NULL)
+    {
+      if (p != NULL)
+        list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt = 1;
+      f->dirty = false;
+      f->inode = NULL;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Returns a pinned frame for page P of the current process,
+   evicting some other page if the user pool is empty.  Returns a
+   null pointer if no frame can be had.
+
+   The caller fills the frame, maps it, sets P's `frame' member,
+   and then calls frame_unpin(). */
+struct frame *
+frame_alloc (struct page *p)
+{
+  return alloc (p, true, false);
+}
+
+/* Like frame_alloc(), but fills the frame with zeros.  This is
+   often free, since the user pool keeps some pages zeroed ahead
+   of time. */
+struct frame *
+frame_alloc_zero (struct page *p)
+{
+  return alloc (p, true, true);
+}
+
+/* Like frame_alloc(), but returns a null pointer instead of
+   evicting a page if the user pool is empty. */
+struct frame *
+frame_try_alloc (struct page *p)
+{
+  return alloc (p, false, false);
+}
+
+/* Looks for the shared frame that holds the page at offset OFS
+   in the file whose inode is INODE.  If there is one, adds page P
+   to it and returns it, pinned.  Otherwise, returns a null
+   pointer. */
+struct frame *
+frame_get_shared (struct page *p, struct inode *inode, off_t ofs)
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  lock_acquire (&frame_lock);
+  e = hash_find (&shared_frames, &key.share_elem);
+  if (e != NULL)
+    {
+      f = hash_entry (e, struct frame, share_elem);
+      list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt++;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* If page P is all zeros, adds it to the zero frame and returns
+   the zero frame, pinned.  P must then be mapped read-only, so
+   that its first write faults and frame_unshare() gives it a
+   frame of its own.  Returns a null pointer if P is not all
+   zeros.
+
+   P's backing is checked here, under frame_lock, because
+   eviction unmaps a page before page_out() records that it moved
+   to swap.  Until the lock is free, P may still look like an
+   all-zero page when it is not. */
+struct frame *
+frame_get_zero (struct page *p)
+{
+  struct frame *f = NULL;
+
+  lock_acquire (&frame_lock);
+  if (p->backing == PAGE_ZERO)
+    {
+      f = &zero_frame;
+      list_push_back (&f->pages, &p->frame_elem);
+      f->pin_cnt++;
+    }
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Offers pinned frame F, which its page has just filled from
+   offset OFS in the file whose inode is INODE, for sharing with
+   other processes that map the same page.  Its page must be
+   read-only. */
+void
+frame_set_shared (struct frame *f, struct inode *inode, off_t ofs)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0 && f->inode == NULL);
+  f->inode = inode;
+  f->ofs = ofs;
+
+  /* If another process filled a frame for the same page at the
+     same time, F stays private. */
+  if (hash_insert (&shared_frames, &f->share_elem) == NULL)
+    inode_reopen (inode);
+  else
+    f->inode = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Adds page P to pinned frame F, for copy-on-write sharing after
+   fork().  DIRTY should be true if the page that F already holds
+   has been modified since it was read in. */
+void
+frame_share (struct frame *f, struct page *p, bool dirty)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  list_push_back (&f->pages, &p->frame_elem);
+  if (dirty)
+    f->dirty = true;
+  lock_release (&frame_lock);
+}
+
+/* Gives page P, whose frame the caller has pinned, a frame of its
+   own, copying the old frame if other pages still share it or if
+   it is the zero frame.
+   Returns P's frame, pinned.  If no frame can be had, drops the
+   caller's pin and returns a null pointer. */
+struct frame *
+frame_unshare (struct page *p)
+{
+  struct frame *f = p->frame;
+  struct frame *copy;
+  bool alone;
+
+  lock_acquire (&frame_lock);
+  alone = f != &zero_frame && list_size (&f->pages) == 1;
+  lock_release (&frame_lock);
+  if (alone)
+    return f;
+
+  copy = alloc (NULL, true, f == &zero_frame);
+  if (copy == NULL)
+    {
+      frame_unpin (f);
+      return NULL;
+    }
+  if (f != &zero_frame)
+    memcpy (copy->kpage, f->kpage, PGSIZE);
+
+  lock_acquire (&frame_lock);
+  list_remove (&p->frame_elem);
+  list_push_back (&copy->pages, &p->frame_elem);
+  copy->dirty = f->dirty;
+  p->frame = copy;
+  f->pin_cnt--;
+  if (list_empty (&f->pages) && f != &zero_frame)
+    release (f);
+  lock_release (&frame_lock);
+  return copy;
+}
+
+/* Pins the frame that holds page P, if P is in memory, and
+   returns true.  Returns false if P is not in memory. */
+bool
+frame_pin (struct page *p)
+{
+  bool pinned = false;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL)
+    {
+      p->frame->pin_cnt++;
+      pinned = true;
+    }
+  lock_release (&frame_lock);
+  return pinned;
+}
+
+/* Unpins frame F, so that it may be evicted again. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Removes frame F from the frame table and returns its memory to
+   the user pool.  F must not hold any pages. */
+static void
+release (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (list_empty (&f->pages));
+
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  if (f->inode != NULL)
+    {
+      hash_delete (&shared_frames, &f->share_elem);
+      inode_close (f->inode);
+    }
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Removes page P from frame F, which the caller has pinned, and
+   drops the caller's pin.  Frees F if P was its last page.  The
+   caller must already have unmapped P. */
+void
+frame_free (struct frame *f, struct page *p)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  list_remove (&p->frame_elem);
+  f->pin_cnt--;
+  if (list_empty (&f->pages) && f != &zero_frame)
+    release (f);
+  lock_release (&frame_lock);
+}
+
+/* Returns the frame under the clock hand and advances the hand,
+   wrapping around at the end of the table. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  if (hand == list_end (&frames))
+    hand = list_begin (&frames);
+  f = list_entry (hand, struct frame, elem);
+  hand = list_next (hand);
+  return f;
+}
+
+/* Returns true if any page in frame F has been accessed since the
+   last sweep, clearing the accessed bits. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Returns true if frame F's contents differ from its pages'
+   backing. */
+static bool
+is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->dirty)
+    return true;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+        return true;
+    }
+  return false;
+}
+
+/* Chooses a frame with the clock algorithm, takes it away from
+   its pages, and returns it.  Returns a null pointer if no frame
+   can be evicted. */
+static struct frame *
+evict (void)
+{
+  struct frame *victim = NULL;
+  struct frame *dirty[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t dirty_cnt = 0;
+  size_t slot, slot_cnt = SWAP_CLUSTER;
+  size_t i, n;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* Set aside a run of slots for the dirty pages we find. */
+  slot = swap_alloc (&slot_cnt);
+
+  /* Two sweeps clear every accessed bit on the first, so a frame
+     that can be evicted at all is found by the second.  Stop at
+     the first clean frame or once the run of slots is full. */
+  n = 2 * list_size (&frames);
+  for (i = 0; (i < n && victim == NULL
+                && (dirty_cnt == 0 || dirty_cnt < slot_cnt)); i++)
+    {
+      struct frame *f = clock_next ();
+      struct page *p;
+      struct list_elem *e;
+      enum intr_level old_level;
+      bool modified, to_swap;
+
+      if (f->pin_cnt > 0 || test_and_clear_accessed (f))
+        continue;
+
+      /* Decide and unmap with interrupts off, so that no owner can
+         dirty the frame in between.  Memory-mapped pages are
+         never shared, so the first page speaks for all. */
+      p = list_entry (list_front (&f->pages), struct page, frame_elem);
+      old_level = intr_disable ();
+      modified = is_dirty (f);
+      to_swap = modified && !p->write_back;
+      if (!to_swap || dirty_cnt < slot_cnt)
+        for (e = list_begin (&f->pages); e != list_end (&f->pages);
+             e = list_next (e))
+          page_unmap (list_entry (e, struct page, frame_elem));
+      intr_set_level (old_level);
+      if (to_swap && dirty_cnt >= slot_cnt)
+        continue;
+
+      while (!list_empty (&f->pages))
+        {
+          e = list_pop_front (&f->pages);
+          page_out (list_entry (e, struct page, frame_elem), f->kpage,
+                    modified, to_swap ? slot + dirty_cnt : SWAP_NONE);
+        }
+      f->dirty = false;
+      if (f->inode != NULL)
+        {
+          hash_delete (&shared_frames, &f->share_elem);
+          inode_close (f->inode);
+          f->inode = NULL;
+        }
+
+      if (to_swap)
+        {
+          dirty[dirty_cnt] = f;
+          kpages[dirty_cnt++] = f->kpage;
+        }
+      else
+        victim = f;
+    }
+
+  if (dirty_cnt < slot_cnt)
+    swap_free (slot + dirty_cnt, slot_cnt - dirty_cnt);
+  if (dirty_cnt > 0)
+    {
+      swap_write (slot, kpages, dirty_cnt);
+      for (i = 0; i < dirty_cnt; i++)
+        if (victim == NULL)
+          victim = dirty[i];
+        else
+          release (dirty[i]);
+    }
+  return victim;
+}
+
+/* Returns a hash value for shared frame F. */
+static unsigned
+frame_hash (const struct hash_elem *f_, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (f_, struct frame, share_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, share_elem);
+  const struct frame *b = hash_entry (b_, struct frame, share_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
@@ -0,0 +1,45 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct page;
+
+/* A frame of physical memory that holds user pages.
+
+   Usually a frame holds a single process's page.  A read-only
+   page of a file, such as executable text, is instead shared by
+   every process that maps the same part of the same file.  After
+   fork(), parent and child share their pages copy-on-write. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address. */
+    struct list pages;          /* Pages mapped to this frame. */
+    unsigned pin_cnt;           /* Exempt from eviction if nonzero. */
+    bool dirty;                 /* Differs from pages' backing? */
+    struct list_elem elem;      /* Element in frame table. */
+
+    /* Shared file pages. */
+    struct inode *inode;        /* File's inode, or null if private. */
+    off_t ofs;                  /* Offset in file. */
+    struct hash_elem share_elem; /* Element in shared frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+struct frame *frame_alloc_zero (struct page *);
+struct frame *frame_try_alloc (struct page *);
+struct frame *frame_get_shared (struct page *, struct inode *, off_t);
+struct frame *frame_get_zero (struct page *);
+void frame_set_shared (struct frame *, struct inode *, off_t);
+void frame_share (struct frame *, struct page *, bool dirty);
+struct frame *frame_unshare (struct page *);
+bool frame_pin (struct page *);
+void frame_unpin (struct frame *);
+void frame_free (struct frame *, struct page *);
+
+#endif /* vm/frame.h */
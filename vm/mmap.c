@@ -0,0 +1,125 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* The code in this file implements memory-mapped files.  A
+   mapping is just a run of pages in the supplemental page table
+   whose backing is the file, so they are read in lazily on first
+   touch like executable pages.  Unlike those, they are written
+   back to the file, rather than to swap, when they are dirty and
+   leave memory, and when the mapping goes away. */
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* File, reopened for the mapping. */
+    uint8_t *addr;              /* First page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space at ADDR,
+   which must be page-aligned, and returns the new mapping's
+   identifier.  Returns -1 if ADDR is unsuitable, if FILE is
+   empty, if the mapping would reach into the region reserved for
+   the stack, or if any of the pages it needs is already in
+   use. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  uintptr_t stack_bottom;
+  size_t i;
+
+  length = file_length (file);
+  stack_bottom = (uintptr_t) PHYS_BASE - page_stack_max;
+  if (addr == NULL || pg_ofs (addr) != 0
+      || (uintptr_t) addr >= stack_bottom
+      || length == 0
+      || (uintptr_t) length > stack_bottom - (uintptr_t) addr)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return -1;
+    }
+  m->addr = addr;
+  m->page_cnt = 0;
+
+  for (i = 0; i < (size_t) length; i += PGSIZE)
+    {
+      size_t read_bytes = length - i < PGSIZE ? length - i : PGSIZE;
+
+      if (!page_add_mmap (m->addr + i, m->file, i, read_bytes))
+        {
+          unmap (m);
+          return -1;
+        }
+      m->page_cnt++;
+    }
+
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Removes the current process's mapping with identifier MAPPING,
+   if there is one, writing back its dirty pages. */
+void
+mmap_unmap (int mapping)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapping)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Removes all of the current process's mappings. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Removes the pages of mapping M, writing back the dirty ones,
+   and frees M. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,529 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* The code in this file keeps track of every page of a user
+   process's address space, so that pages can be brought into
+   memory only when the process first touches them.  load()
+   records where each page of the executable comes from instead
+   of reading it, which makes starting a process take about the
+   same time however big its executable is.  page_fault() then
+   calls page_load() to read in each page on first access.
+
+   Pages live in frames from the frame table (see vm/frame.c),
+   which may take a frame back with page_out() when memory runs
+   short.  A page that is still clean can simply be dropped and
+   read in again later from where it came from.  A dirty page is
+   written to swap, and from then on lives there when it is out
+   of memory.  Its swap slot stays allocated while it is in
+   memory, so that it can be dropped again for free as long as it
+   stays clean.  Pages of memory-mapped files are the exception:
+   they go back to their file instead (see vm/mmap.c).
+
+   A process starts out with a single page of stack.  Further
+   stack pages are added by page_grow_stack() as the process
+   pushes past them, up to page_stack_max bytes. */
+
+/* Maximum size of a process's stack, in bytes. */
+size_t page_stack_max = 8 * 1024 * 1024;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static struct page *page_add (void *upage, bool writable,
+                              enum page_backing);
+
+/* Initializes the current thread's supplemental page table.
+   Returns true if successful, false if memory allocation
+   fails. */
+bool
+page_table_create (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Fills the current thread's new supplemental page table with a
+   copy of PARENT's, for fork().  Pages that PARENT has in memory
+   are shared with it copy-on-write, mapped read-only in both
+   processes.  EXEC_FILE is the current thread's own handle on
+   PARENT's executable, which backs all of its file pages except
+   those of memory-mapped files, which are not inherited.
+   Returns true if successful, false if memory runs out.
+
+   PARENT must be waiting for us, so that its address space holds
+   still. */
+bool
+page_table_fork (struct thread *parent, struct file *exec_file)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *p;
+      struct frame *f;
+
+      if (pp->write_back)
+        continue;
+      p = page_add (pp->upage, pp->writable, pp->backing);
+      if (p == NULL)
+        return false;
+
+      /* Only PARENT can bring its pages into memory, so PARENT's
+         page holds still whether or not we manage to pin it. */
+      f = frame_pin (pp) ? pp->frame : NULL;
+      if (pp->file != NULL)
+        p->file = exec_file;
+      p->ofs = pp->ofs;
+      p->read_bytes = pp->read_bytes;
+      p->backing = pp->backing;
+      if (p->backing == PAGE_SWAP)
+        {
+          p->swap_slot = pp->swap_slot;
+          swap_ref (p->swap_slot);
+        }
+
+      if (f != NULL)
+        {
+          bool dirty = false;
+
+          if (pp->writable)
+            {
+              dirty = pagedir_is_dirty (parent->pagedir, pp->upage);
+              pagedir_clear_page (parent->pagedir, pp->upage);
+              pagedir_set_page (parent->pagedir, pp->upage, f->kpage, false);
+            }
+          if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, false))
+            {
+              frame_unpin (f);
+              return false;
+            }
+          frame_share (f, p, dirty);
+          p->frame = f;
+          frame_unpin (f);
+        }
+    }
+  return true;
+}
+
+/* Destroys the current thread's supplemental page table,
+   unmapping its pages and freeing their frames. */
+void
+page_table_destroy (void)
+{
+  hash_destroy (&thread_current ()->pages, page_free);
+}
+
+/* Adds a new page at UPAGE, which must be page-aligned, to the
+   current thread's supplemental page table, and returns it.
+   Returns a null pointer if UPAGE is already in the table or if
+   memory allocation fails. */
+static struct page *
+page_add (void *upage, bool writable, enum page_backing backing)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->owner = thread_current ();
+  p->writable = writable;
+  p->backing = backing;
+  p->frame = NULL;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->write_back = false;
+  p->swap_slot = SWAP_NONE;
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds a page at UPAGE whose first READ_BYTES bytes come from
+   FILE starting at offset OFS and whose remaining bytes are
+   zero.  FILE must stay open as long as the page exists.
+   Returns true if successful, false on failure. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, writable, read_bytes > 0 ? PAGE_FILE : PAGE_ZERO);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Adds a writable page at UPAGE whose first READ_BYTES bytes are
+   mapped from FILE starting at offset OFS, and to which they are
+   written back when the page is dirty.  FILE must stay open as
+   long as the page exists.  Returns true if successful, false on
+   failure. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  p = page_add (upage, true, PAGE_FILE);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->write_back = true;
+  return true;
+}
+
+/* Removes the current thread's page at UPAGE, writing it back to
+   its file first if necessary. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  ASSERT (p != NULL);
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  page_free (&p->hash_elem, NULL);
+}
+
+/* Adds an all-zero page at UPAGE.
+   Returns true if successful, false on failure. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, writable, PAGE_ZERO) != NULL;
+}
+
+/* Returns the current thread's page that contains UADDR, or a
+   null pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Reads page P, which is in swap, into its frame F.  Also reads
+   in any pages that follow P both in the current thread's address
+   space and in swap, up to SWAP_CLUSTER pages in all, as long as
+   free frames are at hand for them: a process that touches one
+   page of a run it wrote out together is likely to touch the
+   rest soon. */
+static void
+read_swap_run (struct page *p, struct frame *f)
+{
+  struct thread *t = thread_current ();
+  struct page *pages[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt, i;
+
+  pages[0] = p;
+  frames[0] = f;
+  kpages[0] = f->kpage;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + cnt * PGSIZE);
+
+      if (q == NULL || q->frame != NULL || q->backing != PAGE_SWAP
+          || q->swap_slot != p->swap_slot + cnt)
+        break;
+      frames[cnt] = frame_try_alloc (q);
+      if (frames[cnt] == NULL)
+        break;
+      pages[cnt] = q;
+      kpages[cnt] = frames[cnt]->kpage;
+    }
+
+  swap_read (p->swap_slot, kpages, cnt);
+
+  /* Map the pages read ahead.  Our caller maps P. */
+  for (i = 1; i < cnt; i++)
+    if (pagedir_set_page (t->pagedir, pages[i]->upage, kpages[i],
+                          pages[i]->writable))
+      {
+        pages[i]->frame = frames[i];
+        frame_unpin (frames[i]);
+      }
+    else
+      frame_free (frames[i], pages[i]);
+}
+
+/* Brings the current thread's page that contains UADDR into
+   memory and maps it.  WRITE should be true if the page is about
+   to be written, so that an all-zero page gets a frame of its
+   own right away instead of the shared zero frame.  Returns true
+   if successful, false if there is no such page or it cannot be
+   loaded. */
+bool
+page_load (const void *uaddr, bool write)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+  struct inode *inode = NULL;
+  bool writable;
+  struct frame *f;
+  uint8_t *kpage;
+
+  if (p == NULL)
+    return false;
+  if (p->frame != NULL)
+    return true;
+  writable = p->writable;
+
+  /* An all-zero page that is only being read maps the zero frame,
+     read-only, until it is first written. */
+  if (p->backing == PAGE_ZERO && !write)
+    {
+      f = frame_get_zero (p);
+      if (f != NULL)
+        {
+          writable = false;
+          goto map;
+        }
+    }
+
+  /* A read-only page that is all file data, such as a page of
+     executable text, may already be in memory for another
+     process running the same program. */
+  if (p->backing == PAGE_FILE && !p->writable && p->read_bytes == PGSIZE)
+    {
+      inode = file_get_inode (p->file);
+      f = frame_get_shared (p, inode, p->ofs);
+      if (f != NULL)
+        goto map;
+    }
+
+  /* An eviction that is still recording where P went may change
+     its backing from PAGE_ZERO to PAGE_SWAP, but never the other
+     way, and it is done once we have a frame.  So if the backing
+     still reads PAGE_ZERO below, the frame came zeroed. */
+  f = p->backing == PAGE_ZERO ? frame_alloc_zero (p) : frame_alloc (p);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+
+  switch (p->backing)
+    {
+    case PAGE_FILE:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f, p);
+          return false;
+        }
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+      if (inode != NULL)
+        frame_set_shared (f, inode, p->ofs);
+      break;
+
+    case PAGE_ZERO:
+      break;
+
+    case PAGE_SWAP:
+      read_swap_run (p, f);
+      break;
+
+    default:
+      NOT_REACHED ();
+    }
+
+ map:
+  if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, writable))
+    {
+      frame_free (f, p);
+      return false;
+    }
+  p->frame = f;
+  frame_unpin (f);
+  return true;
+}
+
+/* Grows the current thread's stack down to the page that
+   contains UADDR, if an access to UADDR with the stack pointer
+   at ESP looks like a stack access, and brings that page into
+   memory.  Returns true if successful, false if UADDR is not a
+   stack address or the page cannot be loaded.
+
+   PUSH and PUSHA check access permissions before adjusting the
+   stack pointer, so they fault up to 32 bytes below ESP.  Any
+   access below that is a bug, not stack growth.  The stack may
+   not grow beyond page_stack_max bytes below PHYS_BASE.  New
+   stack pages are about to be pushed to, so each gets a frame of
+   its own at once. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  if (!is_user_vaddr (uaddr)
+      || (uintptr_t) uaddr < (uintptr_t) PHYS_BASE - page_stack_max
+      || (uintptr_t) uaddr + 32 < (uintptr_t) esp
+      || page_lookup (uaddr) != NULL)
+    return false;
+  return (page_add_zero (pg_round_down (uaddr), true)
+          && page_load (uaddr, true));
+}
+
+/* Handles a write to the current thread's page that contains
+   UADDR, which faulted because the page is mapped read-only.  If
+   the page is writable, then it shares its frame copy-on-write
+   since fork(), so gives it a frame of its own and maps that
+   writable.  Returns true if successful, false if the page may
+   not be written or no frame can be had. */
+bool
+page_unshare (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+  struct frame *f;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  /* If the page was evicted in the meantime, the write will fault
+     again and read it back in. */
+  if (!frame_pin (p))
+    return true;
+
+  f = frame_unshare (p);
+  if (f == NULL)
+    return false;
+  pagedir_clear_page (t->pagedir, p->upage);
+  pagedir_set_page (t->pagedir, p->upage, f->kpage, true);
+  frame_unpin (f);
+  return true;
+}
+
+/* Called by the frame table, with interrupts off, to unmap page
+   P from its frame. */
+void
+page_unmap (struct page *p)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  pagedir_clear_page (p->owner->pagedir, p->upage);
+  p->frame = NULL;
+}
+
+/* Called by the frame table, which is locked, once it has
+   unmapped page P from its frame KPAGE, to record where P lives
+   now.  If DIRTY is true, then KPAGE differs from P's backing: P
+   is written back to its file if it is memory-mapped, and
+   otherwise moves to swap SLOT, which the caller will write. */
+void
+page_out (struct page *p, const void *kpage, bool dirty, size_t slot)
+{
+  if (!dirty)
+    return;
+  if (p->write_back)
+    {
+      /* The owner cannot read the page back in before we are
+         done, because the frame table is locked. */
+      file_write_at (p->file, kpage, p->read_bytes, p->ofs);
+      return;
+    }
+
+  ASSERT (slot != SWAP_NONE);
+  swap_ref (slot);
+  if (p->backing == PAGE_SWAP)
+    swap_unref (p->swap_slot);
+  p->backing = PAGE_SWAP;
+  p->swap_slot = slot;
+}
+
+/* Brings the current thread's page that contains UADDR into
+   memory, if necessary, and pins it there, so that the kernel
+   may use it through its kernel address.  Returns the kernel
+   address that corresponds to UADDR, or a null pointer if there
+   is no such page or it cannot be loaded. */
+void *
+page_pin (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+
+  if (p == NULL)
+    return NULL;
+  while (!frame_pin (p))
+    if (!page_load (uaddr, false))
+      return NULL;
+  return (uint8_t *) p->frame->kpage + pg_ofs (uaddr);
+}
+
+/* Unpins the page that contains UADDR, which must have been
+   pinned with page_pin(). */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+
+  ASSERT (p != NULL && p->frame != NULL);
+  frame_unpin (p->frame);
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
+
+/* Frees page P, along with its frame if it has one. */
+static void
+page_free (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+
+  if (frame_pin (p))
+    {
+      uint32_t *pd = thread_current ()->pagedir;
+
+      if (p->write_back && pagedir_is_dirty (pd, p->upage))
+        file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+      pagedir_clear_page (pd, p->upage);
+      frame_free (p->frame, p);
+    }
+  if (p->backing == PAGE_SWAP)
+    swap_unref (p->swap_slot);
+  free (p);
+}
@@ -0,0 +1,68 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+
+/* Where a page's contents come from when it is not in memory. */
+enum page_backing
+  {
+    PAGE_FILE,                  /* Read from a file, rest zeroed. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_SWAP                   /* Swap slot. */
+  };
+
+/* A page of a process's virtual address space, whether or not it
+   is currently in memory.  Each process has a "supplemental page
+   table" of these, keyed by user virtual address. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+    void *upage;                /* User virtual address. */
+    struct thread *owner;       /* Process whose page this is. */
+    bool writable;              /* Writable by the process? */
+    enum page_backing backing;  /* Where contents come from. */
+    struct frame *frame;        /* Frame, if in memory. */
+    struct list_elem frame_elem; /* Element in frame's `pages'. */
+
+    /* PAGE_FILE. */
+    struct file *file;          /* File. */
+    off_t ofs;                  /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read, rest zeroed. */
+    bool write_back;            /* Write to FILE when dirty? */
+
+    /* PAGE_SWAP. */
+    size_t swap_slot;           /* Swap slot. */
+  };
+
+struct thread;
+
+/* Maximum size of a process's stack, in bytes. */
+extern size_t page_stack_max;
+
+bool page_table_create (void);
+bool page_table_fork (struct thread *parent, struct file *exec_file);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *uaddr);
+bool page_load (const void *uaddr, bool write);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_unshare (const void *uaddr);
+void page_unmap (struct page *);
+void page_out (struct page *, const void *kpage, bool dirty, size_t slot);
+void *page_pin (const void *uaddr);
+void page_unpin (const void *uaddr);
+
+#endif /* vm/page.h */
@@ -0,0 +1,163 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file divides the swap device into page-sized
+   "slots" and keeps track of which ones are in use.
+
+   Pages are written and read in runs of adjacent slots.  The
+   requests for a run are submitted all at once, so that the
+   block layer merges them into a single command for the disk,
+   instead of seeking back and forth for each page.
+
+   Processes created by fork() share their parent's pages, so a
+   slot may belong to several pages at once.  Each slot has a
+   reference count, and it is freed when the last page lets go of
+   it. */
+
+/* Sectors per slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Swap device, or a null pointer if there is none. */
+static struct block *swap_block;
+
+/* Slots in use, and the number of pages that refer to each.
+   Protected by swap_lock. */
+static struct bitmap *used_slots;
+static uint16_t *ref_cnts;
+static struct lock swap_lock;
+
+/* Sets up swapping to the BLOCK_SWAP device, if there is one. */
+void
+swap_init (void)
+{
+  size_t slot_cnt;
+
+  lock_init (&swap_lock);
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block == NULL)
+    {
+      printf ("swap: no swap device, dirty pages will stay in memory\n");
+      return;
+    }
+
+  slot_cnt = block_size (swap_block) / SECTORS_PER_SLOT;
+  used_slots = bitmap_create (slot_cnt);
+  ref_cnts = calloc (slot_cnt, sizeof *ref_cnts);
+  if (used_slots == NULL || ref_cnts == NULL)
+    PANIC ("swap: bitmap creation failed--swap device is too large");
+  printf ("swap: %zu slots on %s\n", slot_cnt, block_name (swap_block));
+}
+
+/* Allocates a run of up to *CNT adjacent free slots, preferring
+   the longest run available, and returns the first of them.
+   Sets *CNT to the number actually allocated.  Returns SWAP_NONE
+   and sets *CNT to 0 if swap is full or there is no swap
+   device.
+
+   The slots start out with no references.  The caller must give
+   each one at least one with swap_ref() or free it with
+   swap_free(). */
+size_t
+swap_alloc (size_t *cnt)
+{
+  size_t slot = SWAP_NONE;
+
+  ASSERT (*cnt > 0);
+
+  if (used_slots != NULL)
+    {
+      lock_acquire (&swap_lock);
+      for (; *cnt > 0; *cnt /= 2)
+        {
+          slot = bitmap_scan_and_flip (used_slots, 0, *cnt, false);
+          if (slot != BITMAP_ERROR)
+            break;
+        }
+      lock_release (&swap_lock);
+    }
+  if (slot == BITMAP_ERROR || used_slots == NULL)
+    {
+      slot = SWAP_NONE;
+      *cnt = 0;
+    }
+  return slot;
+}
+
+/* Frees the CNT slots starting at SLOT, which were allocated
+   but never referenced. */
+void
+swap_free (size_t slot, size_t cnt)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_all (used_slots, slot, cnt));
+  bitmap_set_multiple (used_slots, slot, cnt, false);
+  lock_release (&swap_lock);
+}
+
+/* Adds a reference to SLOT. */
+void
+swap_ref (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  ASSERT (ref_cnts[slot] < UINT16_MAX);
+  ref_cnts[slot]++;
+  lock_release (&swap_lock);
+}
+
+/* Drops a reference to SLOT, freeing it if that was the last. */
+void
+swap_unref (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (ref_cnts[slot] > 0);
+  if (--ref_cnts[slot] == 0)
+    bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Transfers the CNT pages in KPAGES to or from the run of slots
+   starting at SLOT, and waits for the transfer to finish. */
+static void
+swap_transfer (bool write, size_t slot, void *kpages[], size_t cnt)
+{
+  struct block_request reqs[SWAP_CLUSTER];
+  struct semaphore done;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  sema_init (&done, 0);
+  for (i = 0; i < cnt; i++)
+    {
+      block_request_init (&reqs[i], swap_block, write,
+                          (slot + i) * SECTORS_PER_SLOT, SECTORS_PER_SLOT,
+                          kpages[i]);
+      reqs[i].done = &done;
+      block_submit (&reqs[i]);
+    }
+  for (i = 0; i < cnt; i++)
+    sema_down (&done);
+}
+
+/* Writes the CNT pages in KPAGES to the slots starting at SLOT. */
+void
+swap_write (size_t slot, void *kpages[], size_t cnt)
+{
+  swap_transfer (true, slot, kpages, cnt);
+}
+
+/* Reads the CNT pages in KPAGES from the slots starting at
+   SLOT. */
+void
+swap_read (size_t slot, void *kpages[], size_t cnt)
+{
+  swap_transfer (false, slot, kpages, cnt);
+}
@@ -0,0 +1,20 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Most pages written or read in one run of adjacent swap slots. */
+#define SWAP_CLUSTER 8
+
+/* A swap slot that holds no page. */
+#define SWAP_NONE ((size_t) -1)
+
+void swap_init (void);
+size_t swap_alloc (size_t *cnt);
+void swap_free (size_t slot, size_t cnt);
+void swap_ref (size_t slot);
+void swap_unref (size_t slot);
+void swap_write (size_t slot, void *kpages[], size_t cnt);
+void swap_read (size_t slot, void *kpages[], size_t cnt);
+
+#endif /* vm/swap.h */